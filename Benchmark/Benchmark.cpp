@@ -0,0 +1,724 @@
+/*
+ The MIT License (MIT)
+ 
+ Copyright (c) 2013 Juan Borda
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+
+//  Times the public query paths against SimulatedManager, no hardware needed.
+//  Every case reports nanoseconds and heap allocations per operation.
+//
+//  usage: Benchmark [ directory for generated configs , default /tmp ]
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <fstream>
+#include <sstream>
+#include "SimulatedManager.h"
+#include "HIDReportDescriptor.h"
+
+using namespace HIDCollapse;
+
+////////
+/// ALLOCATION COUNTING
+////////
+
+static unsigned long allocations = 0;
+
+void * operator new( size_t size ) throw( std::bad_alloc )
+{
+    allocations++;
+    void * p = malloc( size ? size : 1 );
+    if( !p ) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete( void * p ) throw()
+{
+    free( p );
+}
+
+void * operator new[]( size_t size ) throw( std::bad_alloc )
+{
+    return operator new( size );
+}
+
+void operator delete[]( void * p ) throw()
+{
+    operator delete( p );
+}
+
+////////
+/// HARNESS
+////////
+
+//results land here so the compiler can't drop the work
+static volatile int64_t sink = 0;
+
+typedef void (*tBody)( void * fixture , unsigned iterations );
+
+static void run( const char * name , tBody body , void * fixture , unsigned iterations )
+{
+    //warm caches and any lazily built state first
+    body( fixture, iterations / 10 + 1 );
+    
+    unsigned long allocationsBefore = allocations;
+    uint64_t start = monotonicMicroseconds();
+    body( fixture, iterations );
+    uint64_t elapsed = monotonicMicroseconds() - start;
+    unsigned long allocated = allocations - allocationsBefore;
+    
+    printf( "%-44s %12.1f ns/op %10.2f allocs/op\n", name,
+           elapsed * 1000.0 / iterations, allocated / (double) iterations );
+}
+
+////////
+/// QUERIES
+////////
+
+static const int BUTTONS = 16;
+static const int AXES = 6;
+static const int PADS = 4;
+
+struct QueryFixture
+{
+    SimulatedManager manager;
+    Index * index;
+    IndexedAxis * axis;
+    std::vector<std::string> buttonNames, axisNames;
+    std::vector<ElementName> hashedNames;
+};
+
+static SimulatedDevice benchPad()
+{
+    SimulatedDevice pad( "HIDCollapse", "Bench Pad", 0x1234, 0x5678 );
+    for( int b = 1; b <= BUTTONS; b++ ) pad.button( b );
+    for( int a = 0; a < AXES; a++ ) pad.axis( 0x1, 0x30 + a, 0, 255 );
+    return pad;
+}
+
+static std::string writeQueryConfig( const std::string & directory )
+{
+    std::string file = directory + "/bench_queries.hidcollapse.txt";
+    std::ofstream out( file.c_str() );
+    out << "map device( \"HIDCollapse Bench Pad\" ) to index( \"bench\" )\n{\n";
+    for( int b = 0; b < BUTTONS; b++ )
+        out << "\telem( 0x9 , 0x" << std::hex << b + 1 << std::dec << " ) : button( \"button " << b << "\" , " << b << " )\n";
+    for( int a = 0; a < AXES; a++ )
+        out << "\telem( 0x1 , 0x" << std::hex << 0x30 + a << std::dec << " ) : axis( \"axis " << a << "\" , " << a << " )\n";
+    out << "}\n";
+    return file;
+}
+
+static void findButtonByName( void * f , unsigned n )
+{
+    QueryFixture & q = * (QueryFixture *) f;
+    for( unsigned i = 0; i < n; i++ )
+        sink += q.manager.findButton( q.buttonNames[ i % BUTTONS ] ) != 0;
+}
+
+static void findButtonByNameAndPlayer( void * f , unsigned n )
+{
+    QueryFixture & q = * (QueryFixture *) f;
+    for( unsigned i = 0; i < n; i++ )
+        sink += q.manager.findButton( q.buttonNames[ i % BUTTONS ], i % PADS ) != 0;
+}
+
+static void findAxisByName( void * f , unsigned n )
+{
+    QueryFixture & q = * (QueryFixture *) f;
+    for( unsigned i = 0; i < n; i++ )
+        sink += q.manager.findAxis( q.axisNames[ i % AXES ] ) != 0;
+}
+
+static void findAxisByNameAndPlayer( void * f , unsigned n )
+{
+    QueryFixture & q = * (QueryFixture *) f;
+    for( unsigned i = 0; i < n; i++ )
+        sink += q.manager.findAxis( q.axisNames[ i % AXES ], i % PADS ) != 0;
+}
+
+static void findAxisByHashedName( void * f , unsigned n )
+{
+    QueryFixture & q = * (QueryFixture *) f;
+    for( unsigned i = 0; i < n; i++ )
+        sink += q.manager.findAxis( q.hashedNames[ i % AXES ], i % PADS ) != 0;
+}
+
+static void indexGetAxisInt( void * f , unsigned n )
+{
+    QueryFixture & q = * (QueryFixture *) f;
+    for( unsigned i = 0; i < n; i++ )
+        sink += q.index->getAxis( (int) ( i % AXES ) ) != 0;
+}
+
+static void indexGetAxisString( void * f , unsigned n )
+{
+    QueryFixture & q = * (QueryFixture *) f;
+    for( unsigned i = 0; i < n; i++ )
+        sink += q.index->getAxis( q.axisNames[ i % AXES ] ) != 0;
+}
+
+static void indexGetAxisHashed( void * f , unsigned n )
+{
+    QueryFixture & q = * (QueryFixture *) f;
+    for( unsigned i = 0; i < n; i++ )
+        sink += q.index->getAxis( q.hashedNames[ i % AXES ] ) != 0;
+}
+
+static void axisNormalizedValue( void * f , unsigned n )
+{
+    QueryFixture & q = * (QueryFixture *) f;
+    for( unsigned i = 0; i < n; i++ )
+        sink += (int64_t) ( q.axis->getNormalizedValue() * 1000 );
+}
+
+static void captureFrame( void * f , unsigned n )
+{
+    QueryFixture & q = * (QueryFixture *) f;
+    for( unsigned i = 0; i < n; i++ )
+        q.manager.capture();
+    sink += q.manager.getStateStore().getSequence();
+}
+
+////////
+/// DEVICE MATCHING
+////////
+
+struct MatchFixture
+{
+    std::vector<DeviceDescriptor> known;
+    std::vector<DeviceDescriptor> probes;
+};
+
+static void fillDeviceList( MatchFixture & m )
+{
+    //what a shelf of config files for common pads and sticks looks like
+    static const struct { const char * manufacturer; const char * product; int64_t vendor, product_id; } devices[] =
+    {
+        { "Logitech", "Dual Action", 0x46d, 0xc216 },
+        { "Logitech", "RumblePad 2 USB", 0x46d, 0xc218 },
+        { "Logitech", "Gamepad F310", 0x46d, 0xc21d },
+        { "Logitech", "Cordless RumblePad 2", 0x46d, 0xc219 },
+        { "Logitech", "Extreme 3D Pro", 0x46d, 0xc215 },
+        { "Logitech", "Attack 3", 0x46d, 0xc214 },
+        { "Logitech", "G29 Driving Force Racing Wheel", 0x46d, 0xc24f },
+        { "Sony", "PLAYSTATION(R)3 Controller", 0x54c, 0x268 },
+        { "Sony Computer Entertainment", "Wireless Controller", 0x54c, 0x5c4 },
+        { "Sony Interactive Entertainment", "Wireless Controller", 0x54c, 0x9cc },
+        { "Sony Interactive Entertainment", "DualSense Wireless Controller", 0x54c, 0xce6 },
+        { "Microsoft", "Controller (XBOX 360 For Windows)", 0x45e, 0x28e },
+        { "Microsoft", "Xbox One Wired Controller", 0x45e, 0x2dd },
+        { "Microsoft", "Xbox Wireless Controller", 0x45e, 0xb12 },
+        { "Microsoft", "SideWinder Force Feedback 2 Joystick", 0x45e, 0x1b },
+        { "Nintendo Co., Ltd.", "Pro Controller", 0x57e, 0x2009 },
+        { "Nintendo", "Wii Remote", 0x57e, 0x306 },
+        { "Saitek", "X52 Flight Control System", 0x6a3, 0x255 },
+        { "Saitek", "Pro Flight X-55 Rhino Stick", 0x738, 0x2215 },
+        { "Thrustmaster", "T.16000M", 0x44f, 0xb10a },
+        { "Thrustmaster", "HOTAS Warthog Joystick", 0x44f, 0x402 },
+        { "Thrustmaster", "HOTAS Warthog Throttle", 0x44f, 0x404 },
+        { "Mad Catz", "Saitek Pro Flight X-56 Rhino Throttle", 0x738, 0xa221 },
+        { "CH Products", "Fighterstick USB", 0x68e, 0xc0f3 },
+        { "CH Products", "Pro Throttle USB", 0x68e, 0xc0f1 },
+        { "8BitDo", "SN30 Pro", 0x2dc8, 0x6101 },
+        { "Valve Software", "Steam Controller", 0x28de, 0x1142 },
+        { "PowerA", "Xbox One Controller", 0x20d6, 0x2001 },
+        { "Hori", "Fighting Commander", 0xf0d, 0xc5 },
+        { "Hori", "Real Arcade Pro.V Kai", 0xf0d, 0x78 },
+        { "Razer", "Wolverine Ultimate", 0x1532, 0xa14 },
+        { "Guillemot", "Dual Analog 3", 0x6f8, 0xa301 },
+        { "Generic", "USB Joystick", 0x79, 0x6 },
+        { "DragonRise Inc.", "Generic USB Joystick", 0x79, 0x11 },
+        { "GreenAsia Inc.", "USB Joystick", 0xe8f, 0x12 },
+        { "Performance Designed Products", "Rock Candy Wired Controller", 0xe6f, 0x11f },
+    };
+    
+    for( size_t i = 0; i < sizeof( devices ) / sizeof( devices[0] ); i++ )
+    {
+        m.known.push_back( DeviceDescriptor( devices[i].manufacturer, devices[i].product,
+                                            devices[i].vendor, devices[i].product_id, -1 ) );
+    }
+    
+    //one that matches by ids, one by name only, one that matches nothing
+    m.probes.push_back( DeviceDescriptor( "Logitech", "Logitech Dual Action", 0x46d, 0xc216, 0x300 ) );
+    m.probes.push_back( DeviceDescriptor( "Sony", "PLAYSTATION(R)3 Controller", -1, -1, -1 ) );
+    m.probes.push_back( DeviceDescriptor( "Acme", "Mystery Stick", 0xdead, 0xbeef, 1 ) );
+}
+
+static void fuzzyCompareDeviceList( void * f , unsigned n )
+{
+    MatchFixture & m = * (MatchFixture *) f;
+    for( unsigned i = 0; i < n; i++ )
+    {
+        const DeviceDescriptor & probe = m.probes[ i % m.probes.size() ];
+        float best = 0.f;
+        for( size_t k = 0; k < m.known.size(); k++ )
+        {
+            float score = m.known[k].fuzzyCompareType( &probe );
+            if( score > best ) best = score;
+        }
+        sink += (int64_t) ( best * 1000 );
+    }
+}
+
+////////
+/// PARSING
+////////
+
+struct ParseFixture
+{
+    std::string file;
+};
+
+static std::string writeLargeConfig( const std::string & directory , int definitions , int entries )
+{
+    std::string file = directory + "/bench_large.hidcollapse.txt";
+    std::ofstream out( file.c_str() );
+    for( int d = 0; d < definitions; d++ )
+    {
+        out << "map device( \"Vendor " << d << " Stick Model " << d * 7 << "\" ) to index( \"index " << d << "\" )\n{\n";
+        for( int e = 0; e < entries; e++ )
+        {
+            if( e % 4 == 3 )
+                out << "\telem( 0x1 , 0x" << std::hex << 0x30 + e % 8 << std::dec << " ) : axis( \"axis " << e << "\" , " << e << " )\n";
+            else if( e % 4 == 2 )
+                out << "\telem( \"element " << e << "\" ) : button( \"named " << e << "\" )\n";
+            else
+                out << "\telem( 0x9 , 0x" << std::hex << e + 1 << std::dec << " ) : button( \"button " << e << "\" , " << e << " )\n";
+        }
+        out << "}\n\n";
+    }
+    return file;
+}
+
+static void parseLargeConfig( void * f , unsigned n )
+{
+    ParseFixture & p = * (ParseFixture *) f;
+    for( unsigned i = 0; i < n; i++ )
+    {
+        ast::hidCollapseList definitions;
+        if( parse_file( p.file, definitions ) )
+            sink += definitions.size();
+    }
+}
+
+////////
+/// REPORT DESCRIPTOR CHECKS
+////////
+
+//what a field of a hand written descriptor must parse to
+struct ExpectedField
+{
+    uint8_t reportID;
+    uint16_t page, usage;
+    uint32_t bitOffset;
+    uint8_t bitSize;
+    bool isSigned, isArray;
+    int32_t logicalMin, logicalMax;
+    //in the sample report, for fields of its report id
+    int32_t value;
+};
+
+struct DescriptorCheck
+{
+    const char * name;
+    const uint8_t * descriptor;
+    size_t descriptorSize;
+    //id byte included where the descriptor numbers its reports
+    const uint8_t * report;
+    size_t reportSize;
+    const ExpectedField * fields;
+    size_t fieldCount;
+};
+
+//two numbered reports: signed sticks and 8 buttons, then a 10 bit throttle
+//and a 16 bit rudder whose one byte maximum 0xff means 255
+static const uint8_t numberedPadDescriptor[] =
+{
+    0x05, 0x01, 0x09, 0x05, 0xa1, 0x01,
+    0x85, 0x01,
+    0x09, 0x30, 0x09, 0x31, 0x15, 0x81, 0x25, 0x7f, 0x75, 0x08, 0x95, 0x02, 0x81, 0x02,
+    0x05, 0x09, 0x19, 0x01, 0x29, 0x08, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x08, 0x81, 0x02,
+    0x85, 0x02,
+    0x05, 0x01, 0x09, 0x32, 0x15, 0x00, 0x26, 0xff, 0x03, 0x75, 0x0a, 0x95, 0x01, 0x81, 0x02,
+    0x75, 0x06, 0x95, 0x01, 0x81, 0x03,
+    0x09, 0x35, 0x15, 0x00, 0x25, 0xff, 0x75, 0x10, 0x95, 0x01, 0x81, 0x02,
+    0xc0
+};
+
+//x -10, y 100, buttons 1 and 3
+static const uint8_t numberedPadReport[] = { 0x01, 0xf6, 0x64, 0x05 };
+
+static const ExpectedField numberedPadFields[] =
+{
+    { 1, 0x01, 0x30, 0, 8, true, false, -127, 127, -10 },
+    { 1, 0x01, 0x31, 8, 8, true, false, -127, 127, 100 },
+    { 1, 0x09, 1, 16, 1, false, false, 0, 1, 1 },
+    { 1, 0x09, 2, 17, 1, false, false, 0, 1, 0 },
+    { 1, 0x09, 3, 18, 1, false, false, 0, 1, 1 },
+    { 1, 0x09, 4, 19, 1, false, false, 0, 1, 0 },
+    { 1, 0x09, 5, 20, 1, false, false, 0, 1, 0 },
+    { 1, 0x09, 6, 21, 1, false, false, 0, 1, 0 },
+    { 1, 0x09, 7, 22, 1, false, false, 0, 1, 0 },
+    { 1, 0x09, 8, 23, 1, false, false, 0, 1, 0 },
+    { 2, 0x01, 0x32, 0, 10, false, false, 0, 1023, 0 },
+    { 2, 0x01, 0x35, 16, 16, false, false, 0, 255, 0 },
+};
+
+//12 buttons reported as two 4 bit array slots, then a hat with a null state
+static const uint8_t arrayPadDescriptor[] =
+{
+    0x05, 0x01, 0x09, 0x05, 0xa1, 0x01,
+    0x09, 0x30, 0x09, 0x31, 0x15, 0x00, 0x26, 0xff, 0x00, 0x75, 0x08, 0x95, 0x02, 0x81, 0x02,
+    0x05, 0x09, 0x19, 0x01, 0x29, 0x0c, 0x15, 0x01, 0x25, 0x0c, 0x75, 0x04, 0x95, 0x02, 0x81, 0x00,
+    0x05, 0x01, 0x09, 0x39, 0x15, 0x00, 0x25, 0x07, 0x75, 0x04, 0x95, 0x01, 0x81, 0x42,
+    0x75, 0x04, 0x95, 0x01, 0x81, 0x03,
+    0xc0
+};
+
+//x 128, y 64, buttons 3 and 12 held, hat east
+static const uint8_t arrayPadReport[] = { 0x80, 0x40, 0xc3, 0x02 };
+
+static const ExpectedField arrayPadFields[] =
+{
+    { 0, 0x01, 0x30, 0, 8, false, false, 0, 255, 128 },
+    { 0, 0x01, 0x31, 8, 8, false, false, 0, 255, 64 },
+    { 0, 0x09, 1, 16, 4, false, true, 1, 12, 0 },
+    { 0, 0x09, 2, 16, 4, false, true, 1, 12, 0 },
+    { 0, 0x09, 3, 16, 4, false, true, 1, 12, 1 },
+    { 0, 0x09, 4, 16, 4, false, true, 1, 12, 0 },
+    { 0, 0x09, 5, 16, 4, false, true, 1, 12, 0 },
+    { 0, 0x09, 6, 16, 4, false, true, 1, 12, 0 },
+    { 0, 0x09, 7, 16, 4, false, true, 1, 12, 0 },
+    { 0, 0x09, 8, 16, 4, false, true, 1, 12, 0 },
+    { 0, 0x09, 9, 16, 4, false, true, 1, 12, 0 },
+    { 0, 0x09, 10, 16, 4, false, true, 1, 12, 0 },
+    { 0, 0x09, 11, 16, 4, false, true, 1, 12, 0 },
+    { 0, 0x09, 12, 16, 4, false, true, 1, 12, 1 },
+    { 0, 0x01, 0x39, 24, 4, false, false, 0, 7, 2 },
+};
+
+static const DescriptorCheck descriptorChecks[] =
+{
+    { "report ids", numberedPadDescriptor, sizeof( numberedPadDescriptor ),
+        numberedPadReport, sizeof( numberedPadReport ),
+        numberedPadFields, sizeof( numberedPadFields ) / sizeof( ExpectedField ) },
+    { "button array", arrayPadDescriptor, sizeof( arrayPadDescriptor ),
+        arrayPadReport, sizeof( arrayPadReport ),
+        arrayPadFields, sizeof( arrayPadFields ) / sizeof( ExpectedField ) },
+};
+
+//parses c's descriptor and decodes its report both field by field and
+//through a plan, printing what differs from what c expects
+static bool checkDescriptor( const DescriptorCheck & c )
+{
+    HIDReportDescriptor d;
+    if( !d.parse( c.descriptor, c.descriptorSize ) )
+    {
+        fprintf( stderr, "%s: descriptor did not parse\n", c.name );
+        return false;
+    }
+    
+    const HIDReportDescriptor::tFields & fields = d.getInputs();
+    if( fields.size() != c.fieldCount )
+    {
+        fprintf( stderr, "%s: %u fields, expected %u\n", c.name, (unsigned) fields.size(), (unsigned) c.fieldCount );
+        return false;
+    }
+    
+    uint8_t id = d.usesReportIDs() ? c.report[0] : 0;
+    const uint8_t * report = d.usesReportIDs() ? c.report + 1 : c.report;
+    size_t length = d.usesReportIDs() ? c.reportSize - 1 : c.reportSize;
+    if( d.getInputReportSize( id ) != c.reportSize )
+    {
+        fprintf( stderr, "%s: report %u is %u bytes, expected %u\n", c.name, id,
+                (unsigned) d.getInputReportSize( id ), (unsigned) c.reportSize );
+        return false;
+    }
+    
+    std::vector<bool> wanted( fields.size() );
+    for( size_t i = 0; i < fields.size(); i++ )
+        wanted[i] = fields[i].reportID == id;
+    HIDReportPlan plan;
+    plan.compile( fields, wanted, id );
+    std::vector<int32_t> values( fields.size(), 0 );
+    std::vector<uint32_t> changed;
+    plan.decode( report, length, &values[0], changed );
+    
+    bool ok = true;
+    for( size_t i = 0; i < fields.size(); i++ )
+    {
+        const HIDReportField & f = fields[i];
+        const ExpectedField & e = c.fields[i];
+        if( f.reportID != e.reportID || f.page != e.page || f.usage != e.usage ||
+           f.bitOffset != e.bitOffset || f.bitSize != e.bitSize ||
+           f.isSigned != e.isSigned || f.isArray != e.isArray ||
+           f.logicalMin != e.logicalMin || f.logicalMax != e.logicalMax )
+        {
+            fprintf( stderr, "%s: field %u is report %u usage %x:%x at bit %u size %u%s%s %d..%d, "
+                    "expected report %u usage %x:%x at bit %u size %u%s%s %d..%d\n", c.name, (unsigned) i,
+                    f.reportID, f.page, f.usage, f.bitOffset, f.bitSize,
+                    f.isSigned ? " signed" : "", f.isArray ? " array" : "", f.logicalMin, f.logicalMax,
+                    e.reportID, e.page, e.usage, e.bitOffset, e.bitSize,
+                    e.isSigned ? " signed" : "", e.isArray ? " array" : "", e.logicalMin, e.logicalMax );
+            ok = false;
+        }
+        else if( wanted[i] && ( values[i] != e.value || f.extract( report, length ) != e.value ) )
+        {
+            fprintf( stderr, "%s: field %u decodes to %d and extracts to %d, expected %d\n", c.name, (unsigned) i,
+                    values[i], f.extract( report, length ), e.value );
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+////////
+/// MATCHER CHECKS
+////////
+
+//a definition declared with a version, probed by devices of that version,
+//of another one and of none, which matches any version
+static bool checkMatcher()
+{
+    static const char config[] =
+        "map device( 0x46d , 0xc216 , 0x300 ) to index( \"versioned\" )\n{\n\telem( 0x9 , 0x1 ) : button( \"a\" )\n}\n";
+    ast::hidCollapseList definitions;
+    if( !parse_buffer( config, config + sizeof( config ) - 1, definitions ) )
+    {
+        fprintf( stderr, "matcher check config did not parse\n" );
+        return false;
+    }
+    DeviceMatcher matcher;
+    matcher.compile( definitions );
+    
+    struct Probe
+    {
+        int64_t version;
+        bool matches;
+    };
+    static const Probe probes[] = { { 0x300, true }, { 0x301, false }, { -1, true }, { 0, true } };
+    
+    bool ok = true;
+    for( size_t i = 0; i < sizeof( probes ) / sizeof( Probe ); i++ )
+    {
+        DeviceDescriptor device( 0x46d, 0xc216, probes[i].version );
+        if( ( matcher.match( &device ) != 0 ) != probes[i].matches )
+        {
+            fprintf( stderr, "device of version %lld %s the versioned definition\n", (long long) probes[i].version,
+                    probes[i].matches ? "does not match" : "matches" );
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+////////
+/// REPORT DECODING
+////////
+
+struct ReportFixture
+{
+    HIDReportDescriptor descriptor;
+    HIDReportPlan plan;
+    std::vector<int32_t> values;
+    std::vector<uint32_t> changed;
+    std::vector<uint8_t> report;
+    std::vector<uint8_t> last;
+};
+
+//an arcade encoder: 128 buttons, 8 signed 16 bit axes and a hat
+static const uint8_t encoderDescriptor[] =
+{
+    0x05, 0x01, 0x09, 0x04, 0xa1, 0x01,
+    0x05, 0x09, 0x19, 0x01, 0x29, 0x80, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x80, 0x81, 0x02,
+    0x05, 0x01, 0x09, 0x30, 0x09, 0x31, 0x09, 0x32, 0x09, 0x33, 0x09, 0x34, 0x09, 0x35, 0x09, 0x36, 0x09, 0x37,
+    0x16, 0x01, 0x80, 0x26, 0xff, 0x7f, 0x75, 0x10, 0x95, 0x08, 0x81, 0x02,
+    0x09, 0x39, 0x15, 0x00, 0x25, 0x07, 0x75, 0x04, 0x95, 0x01, 0x81, 0x42,
+    0x75, 0x04, 0x95, 0x01, 0x81, 0x03,
+    0xc0
+};
+
+//a button and an axis move between reports, the way a held stick does
+static void touchReport( ReportFixture & r , unsigned i )
+{
+    r.report[ i % 16 ] ^= 1;
+    r.report[ 16 + i % 16 ] = (uint8_t) i;
+}
+
+static void decodeWithPlan( void * f , unsigned n )
+{
+    ReportFixture & r = * (ReportFixture *) f;
+    for( unsigned i = 0; i < n; i++ )
+    {
+        touchReport( r, i );
+        r.changed.clear();
+        r.plan.decode( &r.report[0], r.report.size(), &r.values[0], r.changed );
+    }
+    sink += r.changed.size();
+}
+
+//what a backend does per report: skip it if it repeats the last one,
+//else decode only the bytes that differ
+static void diffAndDecode( ReportFixture & r )
+{
+    size_t firstByte, endByte;
+    if( !HIDReportPlan::diff( &r.report[0], &r.last[0], r.report.size(), firstByte, endByte ) )
+        return;
+    r.last = r.report;
+    r.changed.clear();
+    r.plan.decode( &r.report[0], r.report.size(), &r.values[0], r.changed, firstByte, endByte );
+}
+
+static void decodeRepeatedReport( void * f , unsigned n )
+{
+    ReportFixture & r = * (ReportFixture *) f;
+    for( unsigned i = 0; i < n; i++ )
+        diffAndDecode( r );
+    sink += r.changed.size();
+}
+
+static void decodeOneButtonChange( void * f , unsigned n )
+{
+    ReportFixture & r = * (ReportFixture *) f;
+    for( unsigned i = 0; i < n; i++ )
+    {
+        r.report[ i % 16 ] ^= 1;
+        diffAndDecode( r );
+    }
+    sink += r.changed.size();
+}
+
+static void decodeFieldByField( void * f , unsigned n )
+{
+    ReportFixture & r = * (ReportFixture *) f;
+    const HIDReportDescriptor::tFields & fields = r.descriptor.getInputs();
+    for( unsigned i = 0; i < n; i++ )
+    {
+        touchReport( r, i );
+        for( size_t k = 0; k < fields.size(); k++ )
+            r.values[k] = fields[k].extract( &r.report[0], r.report.size() );
+    }
+    sink += r.values[0];
+}
+
+int main( int argc , char ** argv )
+{
+    std::string directory = argc > 1 ? argv[1] : "/tmp";
+    
+    //the library reports progress on std::cout, keep it out of the results
+    std::cout.setstate( std::ios_base::badbit );
+    
+    //timing a decoder that reads the wrong bits would be pointless
+    for( size_t i = 0; i < sizeof( descriptorChecks ) / sizeof( DescriptorCheck ); i++ )
+    {
+        if( !checkDescriptor( descriptorChecks[i] ) )
+            return 1;
+    }
+    printf( "%u report descriptors decode as expected\n", (unsigned) ( sizeof( descriptorChecks ) / sizeof( DescriptorCheck ) ) );
+    if( !checkMatcher() )
+        return 1;
+    printf( "devices of unknown version match versioned definitions\n\n" );
+    
+    {
+        QueryFixture q;
+        for( int p = 0; p < PADS; p++ )
+        {
+            SimulatedDeviceDescriptor * pad = q.manager.plug( benchPad() );
+            pad->setValue( BUTTONS, 200 );
+        }
+        q.manager.initialize( writeQueryConfig( directory ) );
+        q.manager.capture();
+        
+        for( int b = 0; b < BUTTONS; b++ )
+        {
+            std::ostringstream name;
+            name << "button " << b;
+            q.buttonNames.push_back( name.str() );
+        }
+        for( int a = 0; a < AXES; a++ )
+        {
+            std::ostringstream name;
+            name << "axis " << a;
+            q.axisNames.push_back( name.str() );
+            q.hashedNames.push_back( ElementName( name.str() ) );
+        }
+        q.index = q.manager.getPlayer( 0 );
+        q.axis = q.index ? q.index->getAxis( 0 ) : 0;
+        if( !q.index || !q.axis )
+        {
+            fprintf( stderr, "bench config did not bind\n" );
+            return 1;
+        }
+        
+        printf( "\n%d simulated pads, %d buttons and %d axes each\n\n", PADS, BUTTONS, AXES );
+        run( "Manager::findButton( name )", findButtonByName, &q, 1000000 );
+        run( "Manager::findButton( name , player )", findButtonByNameAndPlayer, &q, 1000000 );
+        run( "Manager::findAxis( name )", findAxisByName, &q, 1000000 );
+        run( "Manager::findAxis( name , player )", findAxisByNameAndPlayer, &q, 1000000 );
+        run( "Manager::findAxis( ElementName , player )", findAxisByHashedName, &q, 1000000 );
+        run( "Index::getAxis( int )", indexGetAxisInt, &q, 10000000 );
+        run( "Index::getAxis( string )", indexGetAxisString, &q, 1000000 );
+        run( "Index::getAxis( ElementName )", indexGetAxisHashed, &q, 10000000 );
+        run( "IndexedAxis::getNormalizedValue", axisNormalizedValue, &q, 10000000 );
+        run( "Manager::capture", captureFrame, &q, 100000 );
+    }
+    
+    {
+        MatchFixture m;
+        fillDeviceList( m );
+        char name[64];
+        snprintf( name, sizeof( name ), "fuzzyCompareType over %u devices", (unsigned) m.known.size() );
+        printf( "\n" );
+        run( name, fuzzyCompareDeviceList, &m, 100000 );
+    }
+    
+    {
+        ParseFixture p;
+        p.file = writeLargeConfig( directory, 100, 64 );
+        printf( "\n" );
+        run( "parse_file, 100 definitions of 64 entries", parseLargeConfig, &p, 10 );
+    }
+    
+    {
+        ReportFixture r;
+        if( !r.descriptor.parse( encoderDescriptor, sizeof( encoderDescriptor ) ) )
+        {
+            fprintf( stderr, "bench report descriptor did not parse\n" );
+            return 1;
+        }
+        const HIDReportDescriptor::tFields & fields = r.descriptor.getInputs();
+        r.plan.compile( fields, std::vector<bool>( fields.size(), true ), 0 );
+        r.values.resize( fields.size() );
+        r.changed.reserve( fields.size() );
+        r.report.resize( r.descriptor.getInputReportSize( 0 ) );
+        printf( "\n%u byte input report, %u fields\n\n", (unsigned) r.report.size(), (unsigned) fields.size() );
+        run( "HIDReportPlan::decode", decodeWithPlan, &r, 1000000 );
+        r.last = r.report;
+        run( "diff and decode, report repeated", decodeRepeatedReport, &r, 10000000 );
+        run( "diff and decode, one button changed", decodeOneButtonChange, &r, 1000000 );
+        run( "HIDReportField::extract, every field", decodeFieldByField, &r, 100000 );
+    }
+    
+    return 0;
+}
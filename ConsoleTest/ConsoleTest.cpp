@@ -22,6 +22,9 @@ int main( int argc, char ** argv )
         std::vector<int> players;
         while( !quit )
         {
+            //take this frame's snapshot of every indexed element
+            m->capture();
+            
             //this is how you access all available players
             m->getPlayers( players );
             
@@ -38,7 +41,7 @@ int main( int argc, char ** argv )
             //this is how you quickly access the first available controller
             //use this if you don't want to bother with multiple players/controllers
             IndexedButton * ib = m->findButton("fire");
-            if( ib && ib->isPressed() )
+            if( ib && ib->wasPressedThisFrame() )
             {
                 std::cout << "first available Player [" << ib->getParent()->getPlayer() << "] fire pressed" << std::endl;
             }
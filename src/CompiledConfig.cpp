@@ -0,0 +1,376 @@
+/*
+ The MIT License (MIT)
+ 
+ Copyright (c) 2013 Juan Borda
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+#include "HIDCollapseParser.h"
+
+/*
+ Compiled configs are a flat dump of ast::hidCollapseList:
+ 
+ header      "HIDC" formatVersion:u32 sourceHash:u64
+ list        count:u32 hidCollapse*
+ hidCollapse device string:index count:u32 entry*
+ device      0 string | 1 vendor:u32 product:u32 version:u32 | 2 vendor:u32 product:u32
+ entry       key target
+ key         0 page:u32 usage:u32 | 1 string | 2 int:i32
+ target      0 axis | 1 button , count:u32 targetKey*
+ targetKey   0 string | 1 int:i32
+ string      length:u32 bytes
+ 
+ tags are the variant's which() so bump the version if the ast changes.
+ numbers are native endian, this is a cache and not meant to be shipped
+ */
+
+namespace HIDCollapse
+{
+    static const char COMPILED_MAGIC[4] = { 'H', 'I', 'D', 'C' };
+    static const uint32_t COMPILED_VERSION = 1;
+    
+    uint64_t hash_source( const std::string & text )
+    {
+        //FNV-1a
+        uint64_t h = 14695981039346656037ULL;
+        for( size_t i = 0; i < text.size(); i++ )
+        {
+            h ^= (unsigned char) text[i];
+            h *= 1099511628211ULL;
+        }
+        return h;
+    }
+    
+    namespace
+    {
+        class Writer
+        {
+        public:
+            void u8( uint8_t v ) { raw( &v, 1 ); }
+            void u32( uint32_t v ) { raw( &v, 4 ); }
+            void i32( int32_t v ) { raw( &v, 4 ); }
+            void u64( uint64_t v ) { raw( &v, 8 ); }
+            void str( const std::string & s )
+            {
+                u32( (uint32_t) s.size() );
+                raw( s.data(), s.size() );
+            }
+            void raw( const void * p, size_t n )
+            {
+                buffer.append( (const char *) p, n );
+            }
+            std::string buffer;
+        };
+        
+        //reads from the mapped file, any read past the end fails the whole load
+        class Reader
+        {
+        public:
+            Reader( const char * begin , size_t size ):pos( begin ),end( begin + size ),ok( true )
+            {
+            }
+            uint8_t u8() { uint8_t v = 0; raw( &v, 1 ); return v; }
+            uint32_t u32() { uint32_t v = 0; raw( &v, 4 ); return v; }
+            int32_t i32() { int32_t v = 0; raw( &v, 4 ); return v; }
+            uint64_t u64() { uint64_t v = 0; raw( &v, 8 ); return v; }
+            void str( std::string & out )
+            {
+                uint32_t n = u32();
+                if( !ok || (size_t)( end - pos ) < n ) { ok = false; return; }
+                out.assign( pos, n );
+                pos += n;
+            }
+            void raw( void * p, size_t n )
+            {
+                if( !ok || (size_t)( end - pos ) < n ) { ok = false; return; }
+                memcpy( p, pos, n );
+                pos += n;
+            }
+            const char * pos;
+            const char * end;
+            bool ok;
+        };
+        
+        struct writeDevice: public boost::static_visitor<void>
+        {
+            writeDevice( Writer & w ):w( w ) {}
+            Writer & w;
+            void operator()( const std::string & name ) const { w.str( name ); }
+            void operator()( const ast::deviceTriplet & t ) const { w.u32( t.vendor ); w.u32( t.product ); w.u32( t.version ); }
+            void operator()( const ast::devicePair & p ) const { w.u32( p.vendor ); w.u32( p.product ); }
+        };
+        
+        struct writeKey: public boost::static_visitor<void>
+        {
+            writeKey( Writer & w ):w( w ) {}
+            Writer & w;
+            void operator()( const ast::elemHexPairKey & k ) const { w.u32( k.page ); w.u32( k.usage ); }
+            void operator()( const std::string & s ) const { w.str( s ); }
+            void operator()( int i ) const { w.i32( i ); }
+        };
+        
+        struct writeTarget: public boost::static_visitor<void>
+        {
+            writeTarget( Writer & w ):w( w ) {}
+            Writer & w;
+            void operator()( const ast::indexAxe & a ) const { keys( a.keys ); }
+            void operator()( const ast::indexButton & b ) const { keys( b.keys ); }
+            void keys( const ast::targetElementKeys & keys ) const
+            {
+                w.u32( (uint32_t) keys.size() );
+                for( ast::targetElementKeys::const_iterator k = keys.begin(); k != keys.end(); k++ )
+                {
+                    w.u8( (uint8_t) k->which() );
+                    boost::apply_visitor( writeKey( w ), *k );
+                }
+            }
+        };
+        
+        void readTargetKeys( Reader & r , ast::targetElementKeys & keys )
+        {
+            uint32_t count = r.u32();
+            for( uint32_t i = 0; i < count && r.ok; i++ )
+            {
+                if( r.u8() == 0 )
+                {
+                    std::string s;
+                    r.str( s );
+                    keys.push_back( s );
+                }
+                else
+                {
+                    keys.push_back( (int) r.i32() );
+                }
+            }
+        }
+    }
+    
+    bool write_compiled( const std::string & filename , uint64_t sourceHash , const ast::hidCollapseList & in )
+    {
+        Writer w;
+        w.raw( COMPILED_MAGIC, 4 );
+        w.u32( COMPILED_VERSION );
+        w.u64( sourceHash );
+        
+        w.u32( (uint32_t) in.size() );
+        for( ast::hidCollapseList::const_iterator d = in.begin(); d != in.end(); d++ )
+        {
+            w.u8( (uint8_t) d->device.which() );
+            boost::apply_visitor( writeDevice( w ), d->device );
+            w.str( d->index );
+            
+            w.u32( (uint32_t) d->entries.size() );
+            for( ast::entries::const_iterator e = d->entries.begin(); e != d->entries.end(); e++ )
+            {
+                w.u8( (uint8_t) e->expression.key.which() );
+                boost::apply_visitor( writeKey( w ), e->expression.key );
+                w.u8( (uint8_t) e->indexTarget.which() );
+                boost::apply_visitor( writeTarget( w ), e->indexTarget );
+            }
+        }
+        
+        //write aside and rename so readers never see half a file
+        std::string tmp = filename + ".tmp";
+        {
+            std::ofstream out( tmp.c_str(), std::ios::binary | std::ios::trunc );
+            if( !out.is_open() ) return false;
+            out.write( w.buffer.data(), w.buffer.size() );
+            if( !out.good() ) return false;
+        }
+        if( rename( tmp.c_str(), filename.c_str() ) != 0 )
+        {
+            unlink( tmp.c_str() );
+            return false;
+        }
+        return true;
+    }
+    
+    static bool read_compiled_buffer( const char * data , size_t size , uint64_t sourceHash , ast::hidCollapseList & out )
+    {
+        Reader r( data, size );
+        
+        char magic[4];
+        r.raw( magic, 4 );
+        if( !r.ok || memcmp( magic, COMPILED_MAGIC, 4 ) != 0 ) return false;
+        if( r.u32() != COMPILED_VERSION ) return false;
+        if( r.u64() != sourceHash ) return false;
+        
+        ast::hidCollapseList list;
+        uint32_t count = r.u32();
+        for( uint32_t i = 0; i < count && r.ok; i++ )
+        {
+            list.push_back( ast::hidCollapse() );
+            ast::hidCollapse & d = list.back();
+            
+            switch( r.u8() )
+            {
+                case 0:
+                {
+                    std::string name;
+                    r.str( name );
+                    d.device = name;
+                    break;
+                }
+                case 1:
+                {
+                    ast::deviceTriplet t;
+                    t.vendor = r.u32();
+                    t.product = r.u32();
+                    t.version = r.u32();
+                    d.device = t;
+                    break;
+                }
+                case 2:
+                {
+                    ast::devicePair p;
+                    p.vendor = r.u32();
+                    p.product = r.u32();
+                    d.device = p;
+                    break;
+                }
+                default:
+                    return false;
+            }
+            r.str( d.index );
+            
+            uint32_t entries = r.u32();
+            for( uint32_t j = 0; j < entries && r.ok; j++ )
+            {
+                d.entries.push_back( ast::entry() );
+                ast::entry & e = d.entries.back();
+                
+                switch( r.u8() )
+                {
+                    case 0:
+                    {
+                        ast::elemHexPairKey k;
+                        k.page = r.u32();
+                        k.usage = r.u32();
+                        e.expression.key = k;
+                        break;
+                    }
+                    case 1:
+                    {
+                        std::string s;
+                        r.str( s );
+                        e.expression.key = s;
+                        break;
+                    }
+                    case 2:
+                        e.expression.key = (int) r.i32();
+                        break;
+                    default:
+                        return false;
+                }
+                
+                if( r.u8() == 0 )
+                {
+                    ast::indexAxe a;
+                    readTargetKeys( r, a.keys );
+                    e.indexTarget = a;
+                }
+                else
+                {
+                    ast::indexButton b;
+                    readTargetKeys( r, b.keys );
+                    e.indexTarget = b;
+                }
+            }
+        }
+        
+        if( !r.ok || r.pos != r.end ) return false;
+        out.splice( out.end(), list );
+        return true;
+    }
+    
+    bool read_compiled( const std::string & filename , uint64_t sourceHash , ast::hidCollapseList & out )
+    {
+        int fd = open( filename.c_str(), O_RDONLY );
+        if( fd < 0 ) return false;
+        
+        struct stat st;
+        if( fstat( fd, &st ) != 0 || st.st_size <= 0 )
+        {
+            close( fd );
+            return false;
+        }
+        
+        void * data = mmap( 0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+        close( fd );
+        if( data == MAP_FAILED ) return false;
+        
+        bool res = read_compiled_buffer( (const char *) data, st.st_size, sourceHash, out );
+        munmap( data, st.st_size );
+        return res;
+    }
+    
+    bool parse_file_cached( const std::string & filename , ast::hidCollapseList & out , const std::string & cacheDirectory )
+    {
+        std::ifstream input( filename.c_str(), std::ios::binary );
+        if( !input.is_open() )
+        {
+            std::cout << "Could not open " << filename << std::endl;
+            return false;
+        }
+        std::stringstream text;
+        text << input.rdbuf();
+        const std::string & source = text.str();
+        
+        std::string compiled;
+        if( cacheDirectory.empty() )
+        {
+            compiled = filename + ".compiled";
+        }
+        else
+        {
+            size_t slash = filename.find_last_of( '/' );
+            compiled = cacheDirectory + "/" + ( slash == std::string::npos ? filename : filename.substr( slash + 1 ) ) + ".compiled";
+        }
+        
+        uint64_t sourceHash = hash_source( source );
+        if( read_compiled( compiled, sourceHash, out ) )
+        {
+            return true;
+        }
+        
+        //missing or stale
+        ast::hidCollapseList parsed;
+        if( !parse_buffer( source.data(), source.data() + source.size(), parsed, filename ) )
+        {
+            return false;
+        }
+        
+        if( !write_compiled( compiled, sourceHash, parsed ) )
+        {
+            std::cerr << "Could not write compiled config " << compiled << std::endl;
+        }
+        out.splice( out.end(), parsed );
+        return true;
+    }
+}
@@ -0,0 +1,147 @@
+/*
+ The MIT License (MIT)
+ 
+ Copyright (c) 2013 Juan Borda
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include <algorithm>
+#include "HIDCollapse.h"
+
+namespace HIDCollapse
+{
+    
+    struct makeDescriptor: public boost::static_visitor<DeviceDescriptor>
+    {
+        DeviceDescriptor operator()(const std::string & key ) const
+        {
+            return DeviceDescriptor( key );
+        }
+        DeviceDescriptor operator()(const ast::devicePair & key ) const
+        {
+            return DeviceDescriptor( key.vendor, key.product );
+        }
+        DeviceDescriptor operator()(const ast::deviceTriplet & key ) const
+        {
+            return DeviceDescriptor( key.vendor, key.product, key.version );
+        }
+    };
+    
+    DeviceMatcher::Definition::Definition( const ast::hidCollapse * ast , const DeviceDescriptor & declared ):
+    ast( ast ), declared( declared )
+    {
+    }
+    
+    DeviceMatcher::DeviceMatcher()
+    {
+    }
+    
+    void DeviceMatcher::clear()
+    {
+        definitions.clear();
+        pairs.clear();
+        triplets.clear();
+        tripletPairs.clear();
+        tokens.clear();
+        untokenized.clear();
+    }
+    
+    void DeviceMatcher::compile( const ast::hidCollapseList & list )
+    {
+        clear();
+        
+        for( ast::hidCollapseList::const_iterator d = list.begin(); d != list.end(); d++ )
+        {
+            size_t ordinal = definitions.size();
+            definitions.push_back( Definition( &*d, boost::apply_visitor( makeDescriptor(), d->device ) ) );
+            const DeviceDescriptor & declared = definitions.back().declared;
+            
+            if( declared.getVendorID() > 0 )
+            {
+                tPairKey key( declared.getVendorID(), declared.getProductID() );
+                if( declared.getVersionID() > 0 )
+                {
+                    triplets[ tTripletKey( key, declared.getVersionID() ) ].push_back( ordinal );
+                    tripletPairs[ key ].push_back( ordinal );
+                }
+                else
+                    pairs[ key ].push_back( ordinal );
+                continue;
+            }
+            
+            const DeviceDescriptor::tTokens & words = declared.getTokens();
+            if( words.empty() )
+                untokenized.push_back( ordinal );
+            for( DeviceDescriptor::tTokens::const_iterator w = words.begin(); w != words.end(); w++ )
+                tokens[ *w ].push_back( ordinal );
+        }
+    }
+    
+    const ast::hidCollapse * DeviceMatcher::match( const DeviceDescriptor * physicalDevice ) const
+    {
+        size_t best = definitions.size();
+        
+        //exact ids. definitions declared by id ignore the device's name
+        tPairKey key( physicalDevice->getVendorID(), physicalDevice->getProductID() );
+        tPairTable::const_iterator p = pairs.find( key );
+        if( p != pairs.end() )
+            best = std::min( best, p->second.front() );
+        
+        if( physicalDevice->getVersionID() > 0 )
+        {
+            tTripletTable::const_iterator t = triplets.find( tTripletKey( key, physicalDevice->getVersionID() ) );
+            if( t != triplets.end() )
+                best = std::min( best, t->second.front() );
+        }
+        else
+        {
+            //0 or less is no version, any declared one matches
+            tPairTable::const_iterator t = tripletPairs.find( key );
+            if( t != tripletPairs.end() )
+                best = std::min( best, t->second.front() );
+        }
+        
+        //names. a similarity over the threshold needs at least one shared token
+        //so definitions sharing none are never compared
+        tCandidates candidates( untokenized );
+        
+        const DeviceDescriptor::tTokens & words = physicalDevice->getTokens();
+        for( DeviceDescriptor::tTokens::const_iterator w = words.begin(); w != words.end(); w++ )
+        {
+            tTokenIndex::const_iterator i = tokens.find( *w );
+            if( i != tokens.end() )
+                candidates.insert( candidates.end(), i->second.begin(), i->second.end() );
+        }
+        std::sort( candidates.begin(), candidates.end() );
+        
+        for( tCandidates::iterator c = candidates.begin(); c != candidates.end() && *c < best; c++ )
+        {
+            if( definitions[*c].declared.fuzzyCompareType( physicalDevice ) > DeviceDescriptor::MATCH_THRESHOLD )
+            {
+                best = *c;
+                break;
+            }
+        }
+        
+        if( best < definitions.size() )
+            return definitions[best].ast;
+        return 0;
+    }
+}
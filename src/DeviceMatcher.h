@@ -0,0 +1,83 @@
+/*
+ The MIT License (MIT)
+ 
+ Copyright (c) 2013 Juan Borda
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#pragma once
+#include <string>
+#include <vector>
+#include <utility>
+#include <boost/unordered_map.hpp>
+#include "HIDCollapse.h"
+#include "HIDCollapseParser.h"
+
+namespace HIDCollapse
+{
+    /**
+     * Parsed index definitions compiled once for matching physical devices.
+     * Definitions declared by vendor/product(/version) are found with exact
+     * hash lookups. A device that reports no version matches any version,
+     * like DeviceDescriptor::fuzzyCompareType treats unknown ids. Definitions declared by name are found through an
+     * inverted index of their tokens, so only the ones sharing a token with
+     * the device are fuzzy compared against it.
+     */
+    class HIDC_EXPORT DeviceMatcher
+    {
+    public:
+        DeviceMatcher();
+        
+        //definitions must outlive this matcher or the next compile()
+        void compile( const ast::hidCollapseList & definitions );
+        void clear();
+        
+        //first definition, in declaration order, that matches the device
+        //null if none does
+        const ast::hidCollapse * match( const DeviceDescriptor * physicalDevice ) const;
+        
+    protected:
+        struct Definition
+        {
+            Definition( const ast::hidCollapse * ast , const DeviceDescriptor & declared );
+            const ast::hidCollapse * ast;
+            DeviceDescriptor declared;
+        };
+        
+        typedef std::vector<size_t> tCandidates;
+        typedef std::pair<int64_t, int64_t> tPairKey;
+        typedef std::pair<tPairKey, int64_t> tTripletKey;
+        typedef boost::unordered_map<tPairKey, tCandidates> tPairTable;
+        typedef boost::unordered_map<tTripletKey, tCandidates> tTripletTable;
+        typedef boost::unordered_map<DeviceDescriptor::tToken, tCandidates> tTokenIndex;
+        
+        //in declaration order, candidates are positions in here
+        std::vector<Definition> definitions;
+        
+        tPairTable pairs;
+        tTripletTable triplets;
+        //the triplets again by vendor/product, for devices of unknown version
+        tPairTable tripletPairs;
+        tTokenIndex tokens;
+        
+        //name definitions without any token, always compared
+        tCandidates untokenized;
+    };
+}
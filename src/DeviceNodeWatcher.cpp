@@ -0,0 +1,105 @@
+/*
+ The MIT License (MIT)
+ 
+ Copyright (c) 2013 Juan Borda
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#include "DeviceNodeWatcher.h"
+
+namespace HIDCollapse
+{
+    DeviceNodeWatcher::DeviceNodeWatcher():
+    fd( -1 ),
+    //room for a burst of events, each at most a header and a file name
+    buffer( 64 * ( sizeof( struct inotify_event ) + 256 ) )
+    {
+    }
+    
+    DeviceNodeWatcher::~DeviceNodeWatcher()
+    {
+        stop();
+    }
+    
+    bool DeviceNodeWatcher::watch( const std::string & directory , const std::string & prefix )
+    {
+        stop();
+        
+        fd = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+        if( fd < 0 ) return false;
+        
+        if( inotify_add_watch( fd, directory.c_str(), IN_CREATE | IN_ATTRIB | IN_DELETE ) < 0 )
+        {
+            stop();
+            return false;
+        }
+        
+        this->directory = directory;
+        this->prefix = prefix;
+        return true;
+    }
+    
+    void DeviceNodeWatcher::stop()
+    {
+        if( fd >= 0 )
+        {
+            close( fd );
+        }
+        fd = -1;
+    }
+    
+    bool DeviceNodeWatcher::read( std::vector<std::string> & appeared , std::vector<std::string> & removed )
+    {
+        if( fd < 0 ) return true;
+        
+        bool complete = true;
+        while( true )
+        {
+            ssize_t bytes = ::read( fd, &buffer[0], buffer.size() );
+            if( bytes < 0 && errno == EINTR ) continue;
+            //EAGAIN once nothing is pending
+            if( bytes <= 0 ) return complete;
+            
+            for( ssize_t offset = 0; offset < bytes; )
+            {
+                const struct inotify_event * event = (const struct inotify_event *) &buffer[offset];
+                offset += sizeof( struct inotify_event ) + event->len;
+                
+                if( event->mask & IN_Q_OVERFLOW )
+                    complete = false;
+                
+                if( event->len == 0 || strncmp( event->name, prefix.c_str(), prefix.size() ) != 0 )
+                    continue;
+                
+                std::string path = directory + "/" + event->name;
+                if( event->mask & IN_DELETE )
+                    removed.push_back( path );
+                else
+                    appeared.push_back( path );
+            }
+        }
+    }
+}
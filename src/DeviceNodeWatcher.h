@@ -0,0 +1,65 @@
+/*
+ The MIT License (MIT)
+ 
+ Copyright (c) 2013 Juan Borda
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+
+#pragma once
+#include <string>
+#include <vector>
+#include "HIDCollapse.h"
+
+namespace HIDCollapse
+{
+    /**
+     * Tells which device nodes of a directory appeared or went away
+     * since it was last asked, through inotify, so Linux managers plug
+     * and unplug only those instead of scanning the directory again.
+     * Nodes count as appeared again when their attributes change,
+     * since udev usually grants access only after creating them.
+     */
+    class HIDC_EXPORT DeviceNodeWatcher
+    {
+    public:
+        DeviceNodeWatcher();
+        ~DeviceNodeWatcher();
+        
+        //watches directory for nodes named prefix followed by anything.
+        //returns false if inotify is not available
+        bool watch( const std::string & directory , const std::string & prefix );
+        void stop();
+        
+        //full paths of nodes that appeared and that went away since
+        //the last call, without blocking. either may name a node twice.
+        //returns false if events were lost and the directory needs scanning
+        bool read( std::vector<std::string> & appeared , std::vector<std::string> & removed );
+        
+    private:
+        DeviceNodeWatcher( const DeviceNodeWatcher & );
+        DeviceNodeWatcher & operator=( const DeviceNodeWatcher & );
+        
+        int fd;
+        std::string directory;
+        std::string prefix;
+        std::vector<char> buffer;
+    };
+}
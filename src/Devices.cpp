@@ -22,16 +22,15 @@
  THE SOFTWARE.
  */
 
-#include <sstream>
-#include <set>
+#include <ctype.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <algorithm>
+#include <boost/unordered_map.hpp>
 
 #include "HIDCollapse.h"
 
 //#define LOWERCASE_EQUALS_UPPERCASE
-#if defined ( LOWERCASE_EQUALS_UPPERCASE )
-#include <boost/algorithm/string.hpp>
-#include <locale>
-#endif
 
 namespace HIDCollapse
 {
@@ -109,6 +108,19 @@ namespace HIDCollapse
         return *this;
     }
 
+    ElementBinding::ElementBinding():
+    page( 0xffff ), usage( 0xffff ), cookie( 0xffffffff ), osReference( 0 )
+    {
+    }
+    
+    ElementBinding::ElementBinding( const ElementDescriptor & ed ):
+    page( (uint16_t) ed.hidUsage.page ),
+    usage( (uint16_t) ed.hidUsage.usage ),
+    cookie( (uint32_t) ed.sequential ),
+    osReference( ed.osReference )
+    {
+    }
+    
     std::ostream & operator<<( std::ostream & os , const ElementDescriptor & ed )
     {
         os << "element( " ;
@@ -139,26 +151,29 @@ namespace HIDCollapse
     }
 
     DeviceDescriptor::DeviceDescriptor( int64_t vendorID, int64_t productID , int64_t versionID ):
-    vendorID(vendorID),productID(productID),versionID(versionID)
+    vendorID(vendorID),productID(productID),versionID(versionID),
+    elementsListed(false)
     {
         
     }
     
     DeviceDescriptor::DeviceDescriptor( const std::string & vendor_product_combo ):
-    vendorID(-1),productID(-1),versionID(-1), vendor_product_combo( vendor_product_combo)
+    vendorID(-1),productID(-1),versionID(-1),
+    elementsListed(false)
     {
-        
+        setVendorProductCombo( vendor_product_combo );
     }
     
     DeviceDescriptor::DeviceDescriptor( const std::string & manuf, const std::string & product ,
                                        int64_t vendorID, int64_t productID, int64_t versionID ):
     vendorID(vendorID), productID(productID), versionID(versionID),
-    vendor_product_combo( manuf + " " + product )
+    elementsListed(false)
     {
-        
+        setVendorProductCombo( manuf + " " + product );
     }
 
-    DeviceDescriptor::DeviceDescriptor( const DeviceDescriptor & dd)
+    DeviceDescriptor::DeviceDescriptor( const DeviceDescriptor & dd):
+    elementsListed(false)
     {
         this->copyFrom( &dd );
     }
@@ -182,7 +197,7 @@ namespace HIDCollapse
         factors[0] = intCompare( vendorID, dd->vendorID );
         factors[1] = intCompare( productID, dd->productID );
         factors[2] = intCompare( versionID, dd->versionID );
-        factors[3] = stringSimilarity( vendor_product_combo , dd->vendor_product_combo );
+        factors[3] = tokenSimilarity( tokens , dd->tokens );
         
         float res = 1.f;
         
@@ -208,75 +223,45 @@ namespace HIDCollapse
         return 1.f;
     }
     
-    float DeviceDescriptor::stringSimilarity ( const std::string & s1, const std::string & s2 )
+    float DeviceDescriptor::tokenSimilarity ( const tTokens & t1, const tTokens & t2 )
     {
-        if( s1.compare("") == 0 )
-        {
-            //they are equal
-            if( s2.compare("") == 0 )
-                return 1.0f;
-            //they are not equal or similar
-            else
-                return 0.f ;
-        }
-        
-        //they are not equal or similar
-        if( s2.compare("") == 0 ) return 0.f;
-        
-        using namespace std;
-        //break into tokens and find how many tokens are shared
-        stringstream strstr1( s1 );
-        stringstream strstr2( s2 );
-        
-        // use stream iterators to copy the stream to the vector as whitespace separated strings
-        istream_iterator<string> it1(strstr1);
-        istream_iterator<string> it2(strstr2);
-        istream_iterator<string> end;
-        typedef set<string> tSSet;
-        
-#if defined ( LOWERCASE_EQUALS_UPPERCASE )
-        tSSet set1, set2;
-        while( it1 != end )
-            set1.insert( boost::to_lower_copy(*it1, std::locale("en_US.UTF-8")));
-        while( it2 != end )
-            set2.insert( boost::to_lower_copy(*it2, std::locale("en_US.UTF-8")));
-#else
-        tSSet set1(it1, end);
-        tSSet set2(it2, end);
-#endif
-        
-        tSSet * small, * large;
-        if( set1.size() > set2.size() )
+        const tTokens * small, * large;
+        if( t1.size() > t2.size() )
         {
-            large = & set1;
-            small = & set2;
+            large = & t1;
+            small = & t2;
         }
         else
         {
-            large = & set2;
-            small = & set1;
+            large = & t2;
+            small = & t1;
         }
         
         if( small->size() == 0 )
         {
+            //both empty, they are equal
             if( large->size() == 0 )
                 return 1;
             
-            if( large->size() > 0 )
-                return 0;
+            //they are not equal or similar
+            return 0;
         };
         
-        //compare our two sets
-        int matches = 0;
-        int mismatches = 0;
-        for( tSSet::iterator i = large->begin(); i != large->end() ; ++i )
+        //both are sorted, count shared tokens with a merge
+        size_t matches = 0;
+        tTokens::const_iterator i = small->begin(), j = large->begin();
+        while( i != small->end() && j != large->end() )
         {
-            tSSet::iterator f = small->find( * i );
-            if( f != small->end() )
-                matches ++;
+            if( *i < *j ) i++;
+            else if( *j < *i ) j++;
             else
-                mismatches ++;
+            {
+                matches ++;
+                i++;
+                j++;
+            }
         }
+        size_t mismatches = large->size() - matches;
         
         if( matches == small->size() )
         {
@@ -285,7 +270,7 @@ namespace HIDCollapse
         else
         {
             float res = 0.f;
-            res = ( matches - mismatches ) / ( float ) large->size();
+            res = ( (float) matches - (float) mismatches ) / ( float ) large->size();
             if( res > 1 )
                 return 1;
             else if( res < 0 )
@@ -304,27 +289,168 @@ namespace HIDCollapse
         return false;
     }
 
+    bool DeviceDescriptor::evaluateBinding( const ElementBinding & , int64_t * )
+    {
+        //no elements to bind to here either
+        return false;
+    }
+    
     //overrride by subclasses.
     void DeviceDescriptor::listElementDescriptors( std::vector<ElementDescriptor> & out )
     {
         //do nothing. override in os. subclass
     }
+    
+    const std::vector<ElementDescriptor> & DeviceDescriptor::getElementDescriptors()
+    {
+        if( !elementsListed )
+        {
+            listElementDescriptors( elementDescriptors );
+            elementsListed = true;
+        }
+        return elementDescriptors;
+    }
 
     void DeviceDescriptor::copyFrom( const DeviceDescriptor * dd )
     {
         vendorID = dd->vendorID;
         productID = dd->productID;
-        versionID = dd->vendorID;
+        versionID = dd->versionID;
                 
         //empty string is "no value" and does not affect comparison
         //defaults to whatever std::sring defaults to
         vendor_product_combo = dd->vendor_product_combo;
+        tokens = dd->tokens;
+        identity = dd->identity;
 
     }
 
-    const std::string & DeviceDescriptor::getVendorProductCombo()
+    const std::string & DeviceDescriptor::getVendorProductCombo() const
     {
         return vendor_product_combo;
     }
     
+    const std::string & DeviceDescriptor::getIdentity() const
+    {
+        return identity;
+    }
+    
+    bool DeviceDescriptor::hasSerialIdentity() const
+    {
+        return !identity.empty() && identity[0] != '@';
+    }
+    
+    void DeviceDescriptor::setIdentity( const std::string & serial , const std::string & location )
+    {
+        if( !serial.empty() )
+        {
+            char model[32];
+            snprintf( model, sizeof( model ), "%04llx:%04llx:",
+                     (unsigned long long) vendorID, (unsigned long long) productID );
+            identity = model + serial;
+        }
+        else if( !location.empty() )
+        {
+            identity = "@" + location;
+        }
+        else
+        {
+            identity.clear();
+        }
+    }
+    
+    int64_t DeviceDescriptor::getVendorID() const
+    {
+        return vendorID;
+    }
+    
+    int64_t DeviceDescriptor::getProductID() const
+    {
+        return productID;
+    }
+    
+    int64_t DeviceDescriptor::getVersionID() const
+    {
+        return versionID;
+    }
+    
+    const DeviceDescriptor::tTokens & DeviceDescriptor::getTokens() const
+    {
+        return tokens;
+    }
+    
+    const DeviceDescriptor::tElementChanges & DeviceDescriptor::getChanges() const
+    {
+        return changes;
+    }
+    
+    void DeviceDescriptor::clearChanges()
+    {
+        changes.clear();
+    }
+    
+    void DeviceDescriptor::reportChange( void * osReference , int64_t value , uint64_t time )
+    {
+        if( changes.size() >= MAX_PENDING_CHANGES ) return;
+        ElementChange c;
+        c.osReference = osReference;
+        c.value = value;
+        c.time = time;
+        changes.push_back( c );
+    }
+    
+    void DeviceDescriptor::setVendorProductCombo( const std::string & s )
+    {
+        vendor_product_combo = s;
+        tokenize( vendor_product_combo, tokens );
+    }
+    
+    //guards the interned words. descriptors are built on the input thread
+    //while hot plugging and on the caller's while configs load
+    static pthread_mutex_t tokenMutex = PTHREAD_MUTEX_INITIALIZER;
+    
+    struct TokenLock
+    {
+        TokenLock() { pthread_mutex_lock( &tokenMutex ); }
+        ~TokenLock() { pthread_mutex_unlock( &tokenMutex ); }
+    };
+    
+    void DeviceDescriptor::tokenize( const std::string & s , tTokens & out )
+    {
+        TokenLock lock;
+        
+        //interned words, shared by every descriptor.
+        //only grows, and only while descriptors are built
+        typedef boost::unordered_map<std::string, tToken> tTokenIds;
+        static tTokenIds ids;
+        
+        out.clear();
+        std::string word;
+        for( size_t i = 0; i <= s.size(); i++ )
+        {
+            if( i == s.size() || isspace( (unsigned char) s[i] ) )
+            {
+                if( word.size() > 0 )
+                {
+                    tTokenIds::iterator id = ids.find( word );
+                    if( id == ids.end() )
+                        id = ids.insert( std::make_pair( word, (tToken) ids.size() ) ).first;
+                    out.push_back( id->second );
+                    word.clear();
+                }
+            }
+            else
+            {
+#if defined ( LOWERCASE_EQUALS_UPPERCASE )
+                word += (char) tolower( (unsigned char) s[i] );
+#else
+                word += s[i];
+#endif
+            }
+        }
+        
+        std::sort( out.begin(), out.end() );
+        out.erase( std::unique( out.begin(), out.end() ), out.end() );
+    }
+    
 }
\ No newline at end of file
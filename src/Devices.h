@@ -23,6 +23,7 @@
  */
 
 #pragma once
+#include <stdint.h>
 #include <string>
 #include <vector>
 #include "HIDCollapse.h"
@@ -64,6 +65,24 @@ namespace HIDCollapse
     
     HIDC_EXPORT std::ostream & operator<<( std::ostream & , const ElementDescriptor & );
     
+    /**
+     * What reading a bound element takes once it has been found, 16 bytes
+     * so a cache line holds four. The ElementDescriptor it was made from
+     * is only needed again to find the element after osReference went stale,
+     * and for diagnostics
+     */
+    struct HIDC_EXPORT ElementBinding
+    {
+        ElementBinding();
+        explicit ElementBinding( const ElementDescriptor & );
+        
+        //truncated hidUsage, 0xffff where it was unknown
+        uint16_t page, usage;
+        //the element's sequential
+        uint32_t cookie;
+        void * osReference;
+    };
+    
     
     /**
      * Base calss for identifying a type of device
@@ -95,6 +114,10 @@ namespace HIDCollapse
         //overrride by subclasses.
         virtual void listElementDescriptors( std::vector<ElementDescriptor> & out );
         
+        //what listElementDescriptors lists, listed once and kept
+        //for the life of this descriptor
+        const std::vector<ElementDescriptor> & getElementDescriptors();
+        
         //evaluates the state of the element and get it min and max values
         //puts them in outVal, outMin, outMax ( can be null values if not needed )
         //returns true if the element was successfully evaluated
@@ -106,11 +129,65 @@ namespace HIDCollapse
                                                         int64_t * outMin ,
                                                         int64_t * outMax );
         
-        const std::string & getVendorProductCombo();
+        //the value of the element eb.osReference points at, without any lookup.
+        //false if that is not an element of this device, or no longer the one
+        //eb was made from. evaluateElementAndUpdateDescriptor finds it then
+        virtual bool evaluateBinding( const ElementBinding & eb , int64_t * outVal );
+        
+        const std::string & getVendorProductCombo() const;
+        
+        //what tells this unit apart from others of the same model while
+        //it exists: its serial number, else where it is plugged in.
+        //empty where the backend knows neither
+        const std::string & getIdentity() const;
+        //whether that is a serial number, which no other unit shares.
+        //a location only hints, another unit may be plugged in there since
+        bool hasSerialIdentity() const;
+        
+        //0 or less if unknown
+        int64_t getVendorID() const;
+        int64_t getProductID() const;
+        int64_t getVersionID() const;
+        
+        //whitespace separated words of vendor_product_combo, interned.
+        //sorted and unique, so two descriptors compare with a linear merge
+        typedef uint32_t tToken;
+        typedef std::vector<tToken> tTokens;
+        const tTokens & getTokens() const;
+        
+        //a value change the device reported on its own, keyed by
+        //the osReference of the element it happened to
+        struct ElementChange
+        {
+            void * osReference;
+            int64_t value;
+            uint64_t time;
+        };
+        typedef std::vector<ElementChange> tElementChanges;
+        
+        //changes reported since the last clearChanges(), oldest first.
+        //stays empty on devices that can only be asked for current values
+        const tElementChanges & getChanges() const;
+        void clearChanges();
+        
+        //changes past this many between clearChanges() are dropped
+        static const size_t MAX_PENDING_CHANGES = 1024;
+        
     protected:
         
+        //for subclasses, while their owner polls them
+        void reportChange( void * osReference , int64_t value , uint64_t time );
+        
         static float intCompare( int64_t i1, int64_t i2 );
-        static float stringSimilarity ( const std::string & s1, const std::string & s2 );
+        static float tokenSimilarity ( const tTokens & t1, const tTokens & t2 );
+        
+        //sets vendor_product_combo and its tokens
+        void setVendorProductCombo( const std::string & );
+        //sets identity from a serial number, qualified by vendor and product
+        //since those are only unique per model, or else from a location
+        //marked with a leading '@' 
+        void setIdentity( const std::string & serial , const std::string & location );
+        static void tokenize( const std::string & s , tTokens & out );
         
         //0 or less values are "no value" and do not affect comparison
         //defaults to -1
@@ -119,7 +196,17 @@ namespace HIDCollapse
         //empty string is "no value" and does not affect comparison
         //defaults to whatever std::sring defaults to
         std::string vendor_product_combo;
+        tTokens tokens;
+        
+        std::string identity;
+        
+        //not copied, capacity is kept across clearChanges()
+        tElementChanges changes;
         
+        //not copied. subclasses that build descriptors anyway
+        //can fill it and set elementsListed up front
+        std::vector<ElementDescriptor> elementDescriptors;
+        bool elementsListed;
     };
 };
 
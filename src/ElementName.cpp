@@ -0,0 +1,50 @@
+/*
+ The MIT License (MIT)
+ 
+ Copyright (c) 2013 Juan Borda
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+
+#include <string.h>
+#include "HIDCollapse.h"
+
+namespace HIDCollapse
+{
+    
+    ElementName::ElementName( const char * name ):name( name ),hash( hashOf( this->name ) )
+    {
+    }
+    
+    ElementName::ElementName( const std::string & name ):name( name ),hash( hashOf( this->name ) )
+    {
+    }
+    
+    ElementName::tHash ElementName::hashOf( const char * s , size_t length )
+    {
+        tHash h = 2166136261u;
+        for( size_t i = 0; i < length; i++ )
+        {
+            h ^= (unsigned char) s[i];
+            h *= 16777619u;
+        }
+        return h;
+    }
+}
@@ -0,0 +1,71 @@
+/*
+ The MIT License (MIT)
+ 
+ Copyright (c) 2013 Juan Borda
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include "HIDCollapse.h"
+
+namespace HIDCollapse
+{
+    /**
+     * An element name hashed once, for looking elements up by name
+     * without touching its characters again:
+     *
+     * static const ElementName camera( "camera left/right" );
+     * IndexedAxis * a = index->getAxis( camera );
+     *
+     * Names whose hashes collide within an index are reported when the
+     * config is loaded, and looked up by their string instead.
+     */
+    class HIDC_EXPORT ElementName
+    {
+    public:
+        typedef uint32_t tHash;
+        
+        explicit ElementName( const char * name );
+        explicit ElementName( const std::string & name );
+        
+        tHash getHash() const { return hash; }
+        
+        //for tooling and the collision fallback
+        const std::string & str() const { return name; }
+        
+        //32 bit FNV-1a
+        static tHash hashOf( const char * s , size_t length );
+        static tHash hashOf( const std::string & s ) { return hashOf( s.data(), s.size() ); }
+        
+        //hashes are already well mixed, use them as they are in hash tables
+        struct Identity
+        {
+            size_t operator()( tHash h ) const { return h; }
+        };
+        
+    private:
+        std::string name;
+        tHash hash;
+    };
+}
@@ -0,0 +1,103 @@
+/*
+ The MIT License (MIT)
+ 
+ Copyright (c) 2013 Juan Borda
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+
+#if defined( __APPLE__ )
+#include <mach/mach_time.h>
+#else
+#include <time.h>
+#endif
+#include "HIDCollapse.h"
+
+namespace HIDCollapse
+{
+    
+    uint64_t monotonicMicroseconds()
+    {
+#if defined( __APPLE__ )
+        static mach_timebase_info_data_t timebase;
+        if( timebase.denom == 0 )
+            mach_timebase_info( &timebase );
+        return mach_absolute_time() * timebase.numer / timebase.denom / 1000;
+#else
+        struct timespec ts;
+        clock_gettime( CLOCK_MONOTONIC, &ts );
+        return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+    }
+    
+    EventQueue::EventQueue( size_t capacity ):head( 0 ),tail( 0 ),dropped( 0 )
+    {
+        size_t size = 1;
+        while( size < capacity ) size <<= 1;
+        events = new InputEvent[size];
+        mask = size - 1;
+    }
+    
+    EventQueue::~EventQueue()
+    {
+        delete [] events;
+    }
+    
+    bool EventQueue::push( const InputEvent & e )
+    {
+        size_t t = tail.load( boost::memory_order_relaxed );
+        if( t - head.load( boost::memory_order_acquire ) > mask )
+        {
+            dropped.fetch_add( 1, boost::memory_order_relaxed );
+            return false;
+        }
+        events[ t & mask ] = e;
+        tail.store( t + 1, boost::memory_order_release );
+        return true;
+    }
+    
+    bool EventQueue::pop( InputEvent & out )
+    {
+        size_t h = head.load( boost::memory_order_relaxed );
+        if( h == tail.load( boost::memory_order_acquire ) )
+            return false;
+        out = events[ h & mask ];
+        head.store( h + 1, boost::memory_order_release );
+        return true;
+    }
+    
+    size_t EventQueue::drain( InputEvent * out , size_t max )
+    {
+        size_t h = head.load( boost::memory_order_relaxed );
+        size_t available = tail.load( boost::memory_order_acquire ) - h;
+        size_t n = available < max ? available : max;
+        for( size_t i = 0; i < n; i++ )
+        {
+            out[i] = events[ ( h + i ) & mask ];
+        }
+        head.store( h + n, boost::memory_order_release );
+        return n;
+    }
+    
+    void EventQueue::discard()
+    {
+        head.store( tail.load( boost::memory_order_acquire ), boost::memory_order_release );
+    }
+}
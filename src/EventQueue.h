@@ -0,0 +1,93 @@
+/*
+ The MIT License (MIT)
+ 
+ Copyright (c) 2013 Juan Borda
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <boost/atomic.hpp>
+#include "HIDCollapse.h"
+
+namespace HIDCollapse
+{
+    //microseconds on the system's monotonic clock, the time base of InputEvent
+    HIDC_EXPORT uint64_t monotonicMicroseconds();
+    
+    //a change of one indexed element as reported by its device
+    struct HIDC_EXPORT InputEvent
+    {
+        Index * index;
+        StateStore::tSlot slot;
+        IndexedElement::Type type;
+        
+        //buttons go between 0 and 1, axes carry raw values
+        int32_t oldValue, newValue;
+        
+        //when the device reported it, see monotonicMicroseconds()
+        uint64_t time;
+    };
+    
+    /**
+     * Bounded ring of InputEvents, allocated once at construction.
+     * One thread pushes ( the one sampling devices ) and one thread pops,
+     * neither ever waits nor allocates.
+     * When full new events are dropped and counted.
+     */
+    class HIDC_EXPORT EventQueue
+    {
+    public:
+        //capacity is rounded up to a power of two
+        EventQueue( size_t capacity = 4096 );
+        ~EventQueue();
+        
+        //writer. returns false if the event was dropped
+        bool push( const InputEvent & e );
+        
+        //reader. returns false if there is nothing pending
+        bool pop( InputEvent & out );
+        
+        //reader. pops up to max events into out, oldest first, returns how many
+        size_t drain( InputEvent * out , size_t max );
+        
+        //reader. forgets every pending event
+        void discard();
+        
+        size_t getCapacity() const { return mask + 1; }
+        
+        //events dropped because the queue was full, since construction
+        uint64_t getDropped() const { return dropped.load( boost::memory_order_relaxed ); }
+        
+    private:
+        EventQueue( const EventQueue & );
+        EventQueue & operator=( const EventQueue & );
+        
+        InputEvent * events;
+        size_t mask;
+        
+        //free running, wrapped by mask on access
+        boost::atomic<size_t> head;     //next to pop, reader's
+        boost::atomic<size_t> tail;     //next to push, writer's
+        boost::atomic<uint64_t> dropped;
+    };
+}
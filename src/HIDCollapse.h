@@ -23,24 +23,33 @@
  */
 #pragma once
 
-#if !defined( HIDC_EXPORT )
-#define HIDC_EXPORT __attribute__((visibility("default")))
-#endif
+#include "HIDCollapseExport.h"
 namespace HIDCollapse
 {
     class Manager;
     class DeviceDescriptor;
     class ElementDescriptor;
     class Index;
+    class IndexLayout;
     class IndexedElement;
     class IndexedButton;
     class IndexedAxis;
+    class StateStore;
+    class DeviceMatcher;
+    class EventQueue;
+    class ElementName;
+    struct InputEvent;
     class tHidUsage;
     
 }
 
 #include "Devices.h"
+#include "ElementName.h"
+#include "StateStore.h"
 #include "IndexedElements.h"
+#include "EventQueue.h"
+#include "IndexTables.h"
 #include "Index.h"
+#include "DeviceMatcher.h"
 #include "Manager.h"
 
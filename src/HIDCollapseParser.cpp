@@ -30,8 +30,6 @@
 #include <boost/fusion/include/adapt_struct.hpp>
 #include <boost/spirit/include/qi.hpp>
 
-#include <boost/spirit/include/support_multi_pass.hpp>
-#include <boost/spirit/include/classic_position_iterator.hpp>
 #if 1
 #include <iomanip>
 #include <fstream>
@@ -261,52 +259,31 @@ namespace HIDCollapse
         return r;
     }
     
-    bool parse_file( const std::string & filename ,
-                    ast::hidCollapseList & out )
+    typedef main_grammar<const char *, boost::spirit::ascii::space_type> buffer_grammar;
+    
+    //building the grammar's rules costs more than parsing a small config,
+    //so every buffer parse shares one
+    static const buffer_grammar & shared_buffer_grammar()
     {
-        std::ifstream input( filename.c_str() );
-        if( input.is_open() )
-        {
-            
-            return parse_istream( input, out );
-        }
-        else
-        {
-            std::cout << "Could not open " << filename << std::endl;
-            return false;
-        }
+        static const buffer_grammar grammar;
+        return grammar;
     }
     
-    bool parse_istream( std::istream & input , ast::hidCollapseList & out )
+    bool parse_buffer( const char * begin , const char * end ,
+                      ast::hidCollapseList & out ,
+                      const std::string & sourceName )
     {
-        //std::ifstream input( filename.c_str() );
-        input >> std::noskipws;
-        
-        // iterate over stream input
-        typedef std::istreambuf_iterator<char> base_iterator_type;
-        base_iterator_type in_begin(input);
-        
-        // convert input iterator to forward iterator, usable by spirit parser
-        typedef boost::spirit::multi_pass<base_iterator_type> forward_iterator_type;
-        forward_iterator_type fwd_begin = boost::spirit::make_default_multi_pass(in_begin);
-        forward_iterator_type fwd_end;
-        
-        // wrap forward iterator with position iterator, to record the position
-        typedef boost::spirit::classic::position_iterator2<forward_iterator_type> pos_iterator_type;
-        pos_iterator_type position_begin(fwd_begin, fwd_end, std::string("input stream"));
-        pos_iterator_type position_end;
-        
-        using namespace HIDCollapse;
+        const char * position = begin;
         
         try
         {
-            bool r = qi::phrase_parse( position_begin ,
-                                      position_end ,
-                                      main_grammar<pos_iterator_type,boost::spirit::ascii::space_type>(),
+            bool r = qi::phrase_parse( position ,
+                                      end ,
+                                      shared_buffer_grammar(),
                                       boost::spirit::ascii::space,
                                       out );
             
-            if( r && position_begin == position_end )
+            if( r && position == end )
             {
                 //TODO: MAKE THIS a logger
                 std::cout << "Parsed HIDCollapseList successfuly." << std::endl;
@@ -319,17 +296,64 @@ namespace HIDCollapse
             return r;
             
         }
-        catch(const qi::expectation_failure<pos_iterator_type>& e)
+        catch(const qi::expectation_failure<const char *>& e)
         {
-            const boost::spirit::classic::file_position_base<std::string>& pos = e.first.get_position();
+            //only now work out where that was
+            int line = 1;
+            const char * lineBegin = begin;
+            for( const char * c = begin; c < e.first; c++ )
+            {
+                if( *c == '\n' )
+                {
+                    line++;
+                    lineBegin = c + 1;
+                }
+            }
+            const char * lineEnd = lineBegin;
+            while( lineEnd < end && *lineEnd != '\n' && *lineEnd != '\r' ) lineEnd++;
+            int column = (int)( e.first - lineBegin ) + 1;
+            
             std::cerr <<
-            "Parse error at file " << pos.file <<
-            " line " << pos.line << " column " << pos.column << std::endl <<
-            "'" << e.first.get_currentline() << "'" << std::endl <<
-            std::setw(pos.column) << " " << "^- here" << std::endl;
+            "Parse error at file " << sourceName <<
+            " line " << line << " column " << column << std::endl <<
+            "'" << std::string( lineBegin, lineEnd ) << "'" << std::endl <<
+            std::setw(column) << " " << "^- here" << std::endl;
         }
         return false;
     }
+    
+    bool parse_file( const std::string & filename ,
+                    ast::hidCollapseList & out )
+    {
+        std::ifstream input( filename.c_str(), std::ios::binary );
+        if( input.is_open() )
+        {
+            //whole file in one contiguous buffer
+            std::string text;
+            input.seekg( 0, std::ios::end );
+            std::streampos size = input.tellg();
+            input.seekg( 0, std::ios::beg );
+            if( size > 0 )
+            {
+                text.resize( (size_t) size );
+                input.read( &text[0], size );
+                text.resize( (size_t) input.gcount() );
+            }
+            
+            return parse_buffer( text.data(), text.data() + text.size(), out, filename );
+        }
+        else
+        {
+            std::cout << "Could not open " << filename << std::endl;
+            return false;
+        }
+    }
+    
+    bool parse_istream( std::istream & input , ast::hidCollapseList & out )
+    {
+        std::string text( ( std::istreambuf_iterator<char>( input ) ) , std::istreambuf_iterator<char>() );
+        return parse_buffer( text.data(), text.data() + text.size(), out, "input stream" );
+    }
 }
 /*
 int main(int argc, char*argv[])
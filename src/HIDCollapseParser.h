@@ -25,6 +25,7 @@ THE SOFTWARE.
 #pragma once
 
 #include <boost/variant.hpp>
+#include <stdint.h>
 #include <list>
 #include <string>
 #include <iostream>
@@ -113,6 +114,26 @@ namespace HIDCollapse
                     ast::hidCollapseList & out );
     bool parse_istream( std::istream & input ,
                         ast::hidCollapseList & out );
+    
+    //parses text already in memory. sourceName is only used in error messages
+    bool parse_buffer( const char * begin , const char * end ,
+                      ast::hidCollapseList & out ,
+                      const std::string & sourceName = "input buffer" );
+    
+    //same as parse_file but through a compiled copy of the file
+    //named <file>.compiled, kept in cacheDirectory or beside the file.
+    //the copy is keyed by a hash of the source text and rebuilt when stale
+    bool parse_file_cached( const std::string & filename ,
+                           ast::hidCollapseList & out ,
+                           const std::string & cacheDirectory = "" );
+    
+    //compiled form of a parsed list. read_compiled fails if the file is
+    //missing, malformed or was compiled from a source with another hash
+    bool write_compiled( const std::string & filename , uint64_t sourceHash ,
+                        const ast::hidCollapseList & in );
+    bool read_compiled( const std::string & filename , uint64_t sourceHash ,
+                       ast::hidCollapseList & out );
+    uint64_t hash_source( const std::string & text );
 
     
 }
@@ -0,0 +1,503 @@
+/*
+ The MIT License (MIT)
+ 
+ Copyright (c) 2013 Juan Borda
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+
+#include <string.h>
+#include "HIDReportDescriptor.h"
+
+namespace HIDCollapse
+{
+    //item types and tags, HID 1.11 section 6.2.2
+    enum
+    {
+        TYPE_MAIN = 0,
+        TYPE_GLOBAL = 1,
+        TYPE_LOCAL = 2,
+        
+        MAIN_INPUT = 0x8,
+        MAIN_OUTPUT = 0x9,
+        MAIN_COLLECTION = 0xa,
+        MAIN_FEATURE = 0xb,
+        MAIN_END_COLLECTION = 0xc,
+        
+        GLOBAL_USAGE_PAGE = 0x0,
+        GLOBAL_LOGICAL_MIN = 0x1,
+        GLOBAL_LOGICAL_MAX = 0x2,
+        GLOBAL_REPORT_SIZE = 0x7,
+        GLOBAL_REPORT_ID = 0x8,
+        GLOBAL_REPORT_COUNT = 0x9,
+        GLOBAL_PUSH = 0xa,
+        GLOBAL_POP = 0xb,
+        
+        LOCAL_USAGE = 0x0,
+        LOCAL_USAGE_MIN = 0x1,
+        LOCAL_USAGE_MAX = 0x2,
+        
+        INPUT_CONSTANT = 0x1,
+        INPUT_VARIABLE = 0x2,
+        INPUT_RELATIVE = 0x4,
+        
+        COLLECTION_APPLICATION = 0x1,
+        
+        LONG_ITEM = 0xfe
+    };
+    
+    //usages ranges are expanded into the usage list, keep that bounded
+    static const uint32_t MAX_USAGES = 4096;
+    
+    uint32_t HIDReportDescriptor::bitsAt( const uint8_t * data , size_t length , uint32_t bitOffset , uint32_t bitSize )
+    {
+        uint32_t value = 0;
+        for( uint32_t b = 0; b < bitSize; b++ )
+        {
+            uint32_t bit = bitOffset + b;
+            if( ( bit >> 3 ) >= length ) break;
+            value |= ( ( data[ bit >> 3 ] >> ( bit & 7 ) ) & 1u ) << b;
+        }
+        return value;
+    }
+    
+    static int32_t signExtend( uint32_t raw , uint32_t bitSize )
+    {
+        if( bitSize < 32 && ( raw >> ( bitSize - 1 ) ) & 1 )
+            raw |= ~0u << bitSize;
+        return (int32_t) raw;
+    }
+    
+    int32_t HIDReportField::extract( const uint8_t * report , size_t length ) const
+    {
+        if( !isArray )
+        {
+            uint32_t raw = HIDReportDescriptor::bitsAt( report, length, bitOffset, bitSize );
+            return isSigned ? signExtend( raw, bitSize ) : (int32_t) raw;
+        }
+        
+        for( uint32_t slot = 0; slot < arrayCount; slot++ )
+        {
+            uint32_t raw = HIDReportDescriptor::bitsAt( report, length, bitOffset + slot * bitSize, bitSize );
+            int32_t value = isSigned ? signExtend( raw, bitSize ) : (int32_t) raw;
+            if( value == arrayValue ) return 1;
+        }
+        return 0;
+    }
+    
+    HIDReportDescriptor::HIDReportDescriptor():reportIDs( false )
+    {
+        memset( inputBits, 0, sizeof( inputBits ) );
+    }
+    
+    size_t HIDReportDescriptor::getInputReportSize( uint8_t reportID ) const
+    {
+        return ( inputBits[reportID] + 7 ) / 8 + ( reportIDs ? 1 : 0 );
+    }
+    
+    namespace
+    {
+        struct GlobalState
+        {
+            uint16_t page;
+            int32_t logicalMin, logicalMax;
+            //bytes of data the logical min and max items had
+            uint8_t logicalMinBytes, logicalMaxBytes;
+            uint32_t reportSize, reportCount;
+            uint8_t reportID;
+        };
+        
+        struct LocalState
+        {
+            //page and usage, expanded from ranges
+            std::vector< std::pair<uint16_t, uint16_t> > usages;
+            bool hasMin;
+            uint32_t usageMin;
+            
+            void clear()
+            {
+                usages.clear();
+                hasMin = false;
+                usageMin = 0;
+            }
+        };
+    }
+    
+    bool HIDReportDescriptor::parse( const uint8_t * bytes , size_t length )
+    {
+        inputs.clear();
+        applications.clear();
+        reportIDs = false;
+        memset( inputBits, 0, sizeof( inputBits ) );
+        
+        GlobalState global;
+        memset( &global, 0, sizeof( global ) );
+        std::vector<GlobalState> globalStack;
+        LocalState local;
+        local.clear();
+        
+        uint32_t cookie = 1;
+        int depth = 0;
+        
+        size_t i = 0;
+        while( i < length )
+        {
+            uint8_t prefix = bytes[i++];
+            
+            if( prefix == LONG_ITEM )
+            {
+                //nothing defines long items yet, skip them
+                if( i + 2 > length ) return false;
+                i += 2 + bytes[i];
+                continue;
+            }
+            
+            size_t size = prefix & 0x3;
+            if( size == 3 ) size = 4;
+            int type = ( prefix >> 2 ) & 0x3;
+            int tag = prefix >> 4;
+            if( i + size > length ) return false;
+            
+            uint32_t data = 0;
+            for( size_t b = 0; b < size; b++ )
+                data |= (uint32_t) bytes[ i + b ] << ( 8 * b );
+            int32_t signedData = size ? signExtend( data, size * 8 ) : 0;
+            i += size;
+            
+            if( type == TYPE_GLOBAL )
+            {
+                switch( tag )
+                {
+                    case GLOBAL_USAGE_PAGE: global.page = (uint16_t) data; break;
+                    case GLOBAL_LOGICAL_MIN:
+                        global.logicalMin = signedData;
+                        global.logicalMinBytes = (uint8_t) size;
+                        break;
+                    case GLOBAL_LOGICAL_MAX:
+                        global.logicalMax = signedData;
+                        global.logicalMaxBytes = (uint8_t) size;
+                        break;
+                    case GLOBAL_REPORT_SIZE: global.reportSize = data; break;
+                    case GLOBAL_REPORT_COUNT: global.reportCount = data; break;
+                    case GLOBAL_REPORT_ID:
+                        global.reportID = (uint8_t) data;
+                        reportIDs = true;
+                        break;
+                    case GLOBAL_PUSH: globalStack.push_back( global ); break;
+                    case GLOBAL_POP:
+                        if( globalStack.empty() ) return false;
+                        global = globalStack.back();
+                        globalStack.pop_back();
+                        break;
+                }
+            }
+            else if( type == TYPE_LOCAL )
+            {
+                //4 byte usages carry their own page
+                uint16_t page = size == 4 ? (uint16_t) ( data >> 16 ) : global.page;
+                switch( tag )
+                {
+                    case LOCAL_USAGE:
+                        if( local.usages.size() < MAX_USAGES )
+                            local.usages.push_back( std::make_pair( page, (uint16_t) data ) );
+                        break;
+                    case LOCAL_USAGE_MIN:
+                        local.hasMin = true;
+                        local.usageMin = data & 0xffff;
+                        break;
+                    case LOCAL_USAGE_MAX:
+                        if( local.hasMin )
+                        {
+                            for( uint32_t u = local.usageMin; u <= ( data & 0xffff ) && local.usages.size() < MAX_USAGES; u++ )
+                                local.usages.push_back( std::make_pair( page, (uint16_t) u ) );
+                            local.hasMin = false;
+                        }
+                        break;
+                }
+            }
+            else if( type == TYPE_MAIN )
+            {
+                if( tag == MAIN_COLLECTION )
+                {
+                    if( depth == 0 && data == COLLECTION_APPLICATION && !local.usages.empty() )
+                        applications.push_back( local.usages.front() );
+                    depth++;
+                    cookie++;
+                }
+                else if( tag == MAIN_END_COLLECTION )
+                {
+                    if( --depth < 0 ) return false;
+                }
+                else if( tag == MAIN_INPUT )
+                {
+                    uint32_t & offset = inputBits[ global.reportID ];
+                    uint32_t base = offset;
+                    offset += global.reportSize * global.reportCount;
+                    
+                    //padding, or wider than a value holds
+                    bool skip = ( data & INPUT_CONSTANT ) || local.usages.empty() ||
+                        global.reportSize == 0 || global.reportSize > 32;
+                    
+                    HIDReportField field;
+                    memset( &field, 0, sizeof( field ) );
+                    field.reportID = global.reportID;
+                    field.bitSize = (uint8_t) global.reportSize;
+                    field.logicalMin = global.logicalMin;
+                    field.logicalMax = global.logicalMax;
+                    //with no negative minimum the maximum was meant unsigned, 0xff for 255.
+                    //the sign came from the item's own size, not the field's
+                    if( field.logicalMin >= 0 && field.logicalMax < field.logicalMin && global.logicalMaxBytes < 4 )
+                        field.logicalMax = (int32_t) ( (uint32_t) field.logicalMax & ( ( 1u << ( 8 * global.logicalMaxBytes ) ) - 1 ) );
+                    field.isSigned = field.logicalMin < 0;
+                    field.isRelative = ( data & INPUT_RELATIVE ) != 0;
+                    
+                    if( !skip && ( data & INPUT_VARIABLE ) )
+                    {
+                        //one element per count, the last usage repeats
+                        for( uint32_t n = 0; n < global.reportCount; n++ )
+                        {
+                            size_t u = n < local.usages.size() ? n : local.usages.size() - 1;
+                            field.page = local.usages[u].first;
+                            field.usage = local.usages[u].second;
+                            field.bitOffset = base + n * global.reportSize;
+                            field.cookie = cookie++;
+                            inputs.push_back( field );
+                        }
+                    }
+                    else if( !skip )
+                    {
+                        //one element per usage the array can report
+                        field.isArray = true;
+                        field.arrayCount = (uint16_t) global.reportCount;
+                        field.bitOffset = base;
+                        for( size_t u = 0; u < local.usages.size(); u++ )
+                        {
+                            field.page = local.usages[u].first;
+                            field.usage = local.usages[u].second;
+                            field.arrayValue = global.logicalMin + (int32_t) u;
+                            field.cookie = cookie++;
+                            inputs.push_back( field );
+                        }
+                    }
+                }
+                local.clear();
+            }
+        }
+        
+        return depth == 0;
+    }
+    
+    //little endian, bytes past length read as 0
+    static inline uint64_t load64( const uint8_t * report , size_t length , uint32_t byteOffset )
+    {
+        uint64_t word = 0;
+        if( byteOffset + 8 <= length )
+        {
+            memcpy( &word, report + byteOffset, 8 );
+#if defined( __BYTE_ORDER__ ) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+            word = __builtin_bswap64( word );
+#endif
+            return word;
+        }
+        for( uint32_t b = 0; b < 8 && byteOffset + b < length; b++ )
+            word |= (uint64_t) report[ byteOffset + b ] << ( 8 * b );
+        return word;
+    }
+    
+    static inline uint32_t byteAt( const uint8_t * report , size_t length , uint32_t byteOffset )
+    {
+        return byteOffset < length ? report[byteOffset] : 0;
+    }
+    
+    //bits of a run a single load covers, whatever its shift
+    static const uint32_t RUN_CHUNK = 56;
+    //lastBits of a run not decoded yet, no run reaches that bit
+    static const uint64_t UNKNOWN_BITS = ( (uint64_t) 1 ) << 63;
+    
+    HIDReportPlan::HIDReportPlan()
+    {
+    }
+    
+    void HIDReportPlan::compile( const HIDReportDescriptor::tFields & fields ,
+                                const std::vector<bool> & wanted , uint8_t reportID )
+    {
+        steps.clear();
+        lastBits.clear();
+        arrays.clear();
+        firstStepAt.clear();
+        
+        for( size_t i = 0; i < fields.size(); i++ )
+        {
+            const HIDReportField & f = fields[i];
+            if( f.reportID != reportID || i >= wanted.size() || !wanted[i] ) continue;
+            
+            Step step;
+            step.shift = f.bitOffset & 7;
+            step.bitSize = f.bitSize;
+            step.isSigned = f.isSigned;
+            step.byteOffset = f.bitOffset >> 3;
+            step.endByte = ( f.bitOffset + f.bitSize * ( f.isArray ? f.arrayCount : 1 ) + 7 ) >> 3;
+            step.mask = 0;
+            step.field = (uint32_t) i;
+            
+            if( f.isArray )
+            {
+                step.kind = ARRAY;
+                step.mask = arrays.size();
+                arrays.push_back( f );
+            }
+            else if( f.bitSize == 1 && !f.isSigned )
+            {
+                //extends the run before it if this bit and field follow on
+                Step * run = steps.empty() ? 0 : & steps.back();
+                if( run && run->kind == BIT_RUN && run->mask < RUN_CHUNK &&
+                   run->field + run->mask == i &&
+                   run->byteOffset * 8 + run->shift + run->mask == f.bitOffset )
+                {
+                    run->mask++;
+                    run->endByte = ( f.bitOffset >> 3 ) + 1;
+                    continue;
+                }
+                step.kind = BIT_RUN;
+                step.mask = 1;
+            }
+            else if( step.shift == 0 && f.bitSize == 8 )
+                step.kind = f.isSigned ? SIGNED_8 : UNSIGNED_8;
+            else if( step.shift == 0 && f.bitSize == 16 )
+                step.kind = f.isSigned ? SIGNED_16 : UNSIGNED_16;
+            else if( f.bitSize == 32 && step.shift == 0 )
+                step.kind = BITS_32;
+            else
+            {
+                step.kind = BITS;
+                step.mask = ( ( (uint64_t) 1 ) << f.bitSize ) - 1;
+            }
+            steps.push_back( step );
+        }
+        
+        //runs look at every bit on their first decode
+        lastBits.assign( steps.size(), UNKNOWN_BITS );
+        
+        //fields come in report order, so do steps unless the descriptor is odd
+        for( size_t s = 1; s < steps.size(); s++ )
+        {
+            if( steps[s].byteOffset < steps[s - 1].byteOffset || steps[s].endByte < steps[s - 1].endByte )
+                return;
+        }
+        if( steps.empty() ) return;
+        firstStepAt.resize( steps.back().endByte );
+        uint32_t step = 0;
+        for( uint32_t b = 0; b < firstStepAt.size(); b++ )
+        {
+            while( steps[step].endByte <= b ) step++;
+            firstStepAt[b] = step;
+        }
+    }
+    
+    bool HIDReportPlan::diff( const uint8_t * a , const uint8_t * b , size_t length ,
+                             size_t & firstByte , size_t & endByte )
+    {
+        //the library memcmp is vectorized, and most reports are the same
+        if( memcmp( a, b, length ) == 0 ) return false;
+        
+        //8 byte compares, inlined as word loads, get close to each end
+        firstByte = 0;
+        while( firstByte + 8 <= length && memcmp( a + firstByte, b + firstByte, 8 ) == 0 )
+            firstByte += 8;
+        while( a[firstByte] == b[firstByte] ) firstByte++;
+        
+        endByte = length;
+        while( endByte >= firstByte + 8 && memcmp( a + endByte - 8, b + endByte - 8, 8 ) == 0 )
+            endByte -= 8;
+        while( a[endByte - 1] == b[endByte - 1] ) endByte--;
+        return true;
+    }
+    
+    void HIDReportPlan::decode( const uint8_t * report , size_t length ,
+                               int32_t * values , std::vector<uint32_t> & changed ,
+                               size_t firstByte , size_t endByte )
+    {
+        size_t s = 0;
+        if( firstStepAt.empty() )
+            endByte = (size_t) -1;
+        else if( firstByte > 0 )
+            s = firstByte < firstStepAt.size() ? firstStepAt[firstByte] : steps.size();
+        
+        for( ; s < steps.size() && steps[s].byteOffset < endByte; s++ )
+        {
+            const Step & step = steps[s];
+            int32_t value;
+            switch( step.kind )
+            {
+                case UNSIGNED_8:
+                    value = byteAt( report, length, step.byteOffset );
+                    break;
+                case SIGNED_8:
+                    value = (int8_t) byteAt( report, length, step.byteOffset );
+                    break;
+                case UNSIGNED_16:
+                    value = byteAt( report, length, step.byteOffset ) |
+                        byteAt( report, length, step.byteOffset + 1 ) << 8;
+                    break;
+                case SIGNED_16:
+                    value = (int16_t) ( byteAt( report, length, step.byteOffset ) |
+                                       byteAt( report, length, step.byteOffset + 1 ) << 8 );
+                    break;
+                case BITS_32:
+                    value = (int32_t) load64( report, length, step.byteOffset );
+                    break;
+                case BITS:
+                {
+                    uint32_t raw = (uint32_t) ( ( load64( report, length, step.byteOffset ) >> step.shift ) & step.mask );
+                    value = step.isSigned ? signExtend( raw, step.bitSize ) : (int32_t) raw;
+                    break;
+                }
+                case BIT_RUN:
+                {
+                    uint64_t runMask = ( ( (uint64_t) 1 ) << step.mask ) - 1;
+                    uint64_t bits = ( load64( report, length, step.byteOffset ) >> step.shift ) & runMask;
+                    uint64_t flipped = lastBits[s] == UNKNOWN_BITS ? runMask : ( bits ^ lastBits[s] );
+                    lastBits[s] = bits;
+                    while( flipped )
+                    {
+                        uint32_t bit = __builtin_ctzll( flipped );
+                        flipped &= flipped - 1;
+                        int32_t v = (int32_t) ( ( bits >> bit ) & 1 );
+                        if( values[ step.field + bit ] != v )
+                        {
+                            values[ step.field + bit ] = v;
+                            changed.push_back( step.field + bit );
+                        }
+                    }
+                    continue;
+                }
+                default:
+                    value = arrays[ step.mask ].extract( report, length );
+                    break;
+            }
+            
+            if( values[step.field] != value )
+            {
+                values[step.field] = value;
+                changed.push_back( step.field );
+            }
+        }
+    }
+}
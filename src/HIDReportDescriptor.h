@@ -0,0 +1,174 @@
+/*
+ The MIT License (MIT)
+ 
+ Copyright (c) 2013 Juan Borda
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <utility>
+#include "HIDCollapseExport.h"
+
+namespace HIDCollapse
+{
+    /**
+     * One input element and where its value sits in an input report.
+     * Variable items give one field per report count, array items one
+     * field per usage they can report, which reads 1 while any of the
+     * array's slots holds that usage.
+     */
+    struct HIDC_EXPORT HIDReportField
+    {
+        uint16_t page, usage;
+        //input fields and collections numbered in descriptor order from 1.
+        //outputs, features and padding are not counted, so unlike OSX's
+        //cookies these only hold for this parser
+        uint32_t cookie;
+        
+        //0 when the device does not number its reports
+        uint8_t reportID;
+        //from the first byte after the report id
+        uint32_t bitOffset;
+        uint8_t bitSize;
+        bool isSigned;
+        bool isRelative;
+        
+        //array fields: how many slots follow bitOffset and what a slot
+        //holds when this field's usage is reported
+        bool isArray;
+        uint16_t arrayCount;
+        int32_t arrayValue;
+        
+        int32_t logicalMin, logicalMax;
+        
+        //the value of this field in report, report id byte excluded
+        int32_t extract( const uint8_t * report , size_t length ) const;
+    };
+    
+    /**
+     * The input side of a HID report descriptor, parsed from its main,
+     * global and local items as the HID spec lays them out.
+     * Output and feature reports are skipped.
+     */
+    class HIDC_EXPORT HIDReportDescriptor
+    {
+    public:
+        HIDReportDescriptor();
+        
+        //false if bytes end in the middle of an item or collections don't close
+        bool parse( const uint8_t * bytes , size_t length );
+        
+        typedef std::vector<HIDReportField> tFields;
+        const tFields & getInputs() const { return inputs; }
+        
+        //usages of the top level application collections, page and usage
+        typedef std::vector< std::pair<uint16_t, uint16_t> > tApplications;
+        const tApplications & getApplications() const { return applications; }
+        
+        //true if every report starts with its id byte
+        bool usesReportIDs() const { return reportIDs; }
+        
+        //bytes of input report id, id byte included
+        size_t getInputReportSize( uint8_t reportID ) const;
+        
+        //reads an unsigned little endian bit field of up to 32 bits.
+        //bits past length read as 0
+        static uint32_t bitsAt( const uint8_t * data , size_t length , uint32_t bitOffset , uint32_t bitSize );
+        
+    private:
+        tFields inputs;
+        tApplications applications;
+        bool reportIDs;
+        //input report bits by report id
+        uint32_t inputBits[256];
+    };
+    
+    /**
+     * How to decode the fields of one input report that something reads,
+     * compiled once so decoding is a flat walk over a few steps.
+     * Byte aligned fields are loaded directly, other fields of up to
+     * 32 bits with one 64 bit load, shift and mask, and runs of 1 bit
+     * fields like button arrays 56 at a time, looking only at the bits
+     * that changed since the last report.
+     */
+    class HIDC_EXPORT HIDReportPlan
+    {
+    public:
+        HIDReportPlan();
+        
+        //plans the fields of reportID whose wanted entry is set
+        void compile( const HIDReportDescriptor::tFields & fields ,
+                     const std::vector<bool> & wanted , uint8_t reportID );
+        
+        //decodes report, id byte excluded, into values indexed like the
+        //fields compiled from, and appends the index of each field
+        //whose value changed to changed.
+        //only fields touching bytes firstByte up to endByte are decoded
+        //when the rest of the report is known to be what values hold
+        void decode( const uint8_t * report , size_t length ,
+                    int32_t * values , std::vector<uint32_t> & changed ,
+                    size_t firstByte = 0 , size_t endByte = (size_t) -1 );
+        
+        //the bytes where a and b differ, false if they are the same
+        static bool diff( const uint8_t * a , const uint8_t * b , size_t length ,
+                         size_t & firstByte , size_t & endByte );
+        
+        bool empty() const { return steps.empty(); }
+        
+    private:
+        enum Kind
+        {
+            UNSIGNED_8,
+            SIGNED_8,
+            UNSIGNED_16,
+            SIGNED_16,
+            BITS_32,
+            BITS,
+            BIT_RUN,
+            ARRAY
+        };
+        
+        struct Step
+        {
+            uint8_t kind;
+            uint8_t shift;
+            uint8_t bitSize;
+            bool isSigned;
+            uint32_t byteOffset;
+            //one past the last byte it reads
+            uint32_t endByte;
+            //BITS mask, BIT_RUN field count, ARRAY index in arrays
+            uint64_t mask;
+            uint32_t field;
+        };
+        
+        std::vector<Step> steps;
+        //BIT_RUN bits as of the last decode, by step
+        std::vector<uint64_t> lastBits;
+        std::vector<HIDReportField> arrays;
+        //by report byte, the first step reading it or anything after it.
+        //empty if steps are not in report order
+        std::vector<uint32_t> firstStepAt;
+    };
+}
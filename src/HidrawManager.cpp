@@ -0,0 +1,452 @@
+/*
+ The MIT License (MIT)
+ 
+ Copyright (c) 2013 Juan Borda
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+
+#include <linux/hidraw.h>
+#include <sys/ioctl.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+
+#include "HidrawManager.h"
+
+namespace HIDCollapse
+{
+    HidrawDeviceDescriptor::HidrawDeviceDescriptor( const std::string & name ,
+                                                   int64_t vendorID, int64_t productID, int64_t versionID ,
+                                                   int fd , const std::string & path ,
+                                                   const HIDReportDescriptor & reports ):
+    DeviceDescriptor( vendorID, productID, versionID ),
+    fd( fd ),
+    path( path ),
+    reportElements( 256 ),
+    reportIDs( reports.usesReportIDs() ),
+    plans( 256 ),
+    lastReports( 256 ),
+    plansDirty( false )
+    {
+        setVendorProductCombo( name );
+        
+        //the serial or bluetooth address, else the usb port path
+        char uniq[256] = "", phys[256] = "";
+        if( fd >= 0 )
+        {
+#if defined( HIDIOCGRAWUNIQ )
+            ioctl( fd, HIDIOCGRAWUNIQ( sizeof( uniq ) ), uniq );
+#endif
+            ioctl( fd, HIDIOCGRAWPHYS( sizeof( phys ) ), phys );
+        }
+        setIdentity( uniq, phys );
+        
+        const HIDReportDescriptor::tFields & fields = reports.getInputs();
+        
+        //sized up front so the maps can point into it
+        elements.resize( fields.size() );
+        size_t largestReport = 0;
+        for( size_t i = 0; i < fields.size(); i++ )
+        {
+            HidrawElement & e = elements[i];
+            e.field = fields[i];
+            e.descriptor.hidUsage.page = e.field.page;
+            e.descriptor.hidUsage.usage = e.field.usage;
+            //report descriptors name nothing, like OSX elements mostly
+            e.descriptor.sequential = e.field.cookie;
+            e.descriptor.osReference = & e;
+            
+            //the last element of a usage wins, same as OSX
+            usageMap[e.descriptor.hidUsage] = & e;
+            seqMap[e.descriptor.sequential] = & e;
+            
+            reportElements[e.field.reportID].push_back( & e );
+            largestReport = std::max( largestReport, reports.getInputReportSize( e.field.reportID ) );
+        }
+        
+        //hidraw hands out one report per read, a byte more tells a longer one apart
+        readBuffer.resize( std::max( largestReport + 1, (size_t) 64 ) );
+        
+        values.assign( elements.size(), 0 );
+        bound.assign( elements.size(), false );
+        
+        readInitialReports();
+    }
+    
+    HidrawDeviceDescriptor::~HidrawDeviceDescriptor()
+    {
+        if( fd >= 0 )
+        {
+            close( fd );
+        }
+    }
+    
+    const std::string & HidrawDeviceDescriptor::getPath() const
+    {
+        return path;
+    }
+    
+    void HidrawDeviceDescriptor::readInitialReports()
+    {
+#if defined( HIDIOCGINPUT )
+        if( fd < 0 ) return;
+        uint64_t now = monotonicMicroseconds();
+        for( size_t id = 0; id < reportElements.size(); id++ )
+        {
+            if( reportElements[id].empty() ) continue;
+            readBuffer[0] = (uint8_t) id;
+            int length = ioctl( fd, HIDIOCGINPUT( readBuffer.size() ), &readBuffer[0] );
+            //the report number leads here even when reads leave it out
+            if( length > 1 )
+                applyReport( &readBuffer[ reportIDs ? 0 : 1 ], length - ( reportIDs ? 0 : 1 ), now );
+        }
+#endif
+    }
+    
+    void HidrawDeviceDescriptor::applyReport( const uint8_t * report , size_t length , uint64_t time )
+    {
+        if( length == 0 ) return;
+        
+        uint8_t id = 0;
+        if( reportIDs )
+        {
+            id = report[0];
+            report++;
+            length--;
+            //an id with nothing after it carries no fields
+            if( length == 0 ) return;
+        }
+        
+        //idle devices repeat the same report, only what differs
+        //from the last one of its id needs decoding
+        std::vector<uint8_t> & last = lastReports[id];
+        size_t firstByte = 0, endByte = (size_t) -1;
+        if( last.size() == length &&
+           !HIDReportPlan::diff( report, &last[0], length, firstByte, endByte ) )
+            return;
+        //kept so elements bound later start from the current state
+        last.assign( report, report + length );
+        
+        if( plansDirty ) compilePlans();
+        HIDReportPlan & plan = plans[id];
+        if( plan.empty() ) return;
+        
+        changedElements.clear();
+        plan.decode( report, length, &values[0], changedElements, firstByte, endByte );
+        for( size_t i = 0; i < changedElements.size(); i++ )
+        {
+            uint32_t e = changedElements[i];
+            reportChange( &elements[e], values[e], time );
+        }
+    }
+    
+    void HidrawDeviceDescriptor::bind( HidrawElement * e )
+    {
+        size_t i = e - &elements[0];
+        if( bound[i] ) return;
+        
+        bound[i] = true;
+        plansDirty = true;
+        const std::vector<uint8_t> & last = lastReports[e->field.reportID];
+        if( !last.empty() )
+            values[i] = e->field.extract( &last[0], last.size() );
+    }
+    
+    void HidrawDeviceDescriptor::compilePlans()
+    {
+        std::vector<HIDReportField> fields( elements.size() );
+        for( size_t i = 0; i < elements.size(); i++ )
+        {
+            fields[i] = elements[i].field;
+        }
+        for( size_t id = 0; id < reportElements.size(); id++ )
+        {
+            if( !reportElements[id].empty() )
+                plans[id].compile( fields, bound, (uint8_t) id );
+        }
+        plansDirty = false;
+    }
+    
+    bool HidrawDeviceDescriptor::drain()
+    {
+        while( true )
+        {
+            ssize_t bytes = read( fd, &readBuffer[0], readBuffer.size() );
+            if( bytes < 0 )
+            {
+                if( errno == EINTR ) continue;
+                //nothing pending
+                if( errno == EAGAIN ) return true;
+                //ENODEV and friends, device is gone
+                return false;
+            }
+            if( bytes == 0 ) return false;
+            
+            //reports carry no timestamp, read time is as close as it gets
+            applyReport( &readBuffer[0], bytes, monotonicMicroseconds() );
+        }
+    }
+    
+    bool HidrawDeviceDescriptor::evaluateElementAndUpdateDescriptor( ElementDescriptor & ed ,
+                                                                    int64_t * outVal ,
+                                                                    int64_t * outMin ,
+                                                                    int64_t * outMax )
+    {
+        HidrawElement * finalElem = 0;
+        
+        //trust the reference only if it is one of ours and still describes the same element
+        if( ed.osReference && !elements.empty() )
+        {
+            HidrawElement * ref = (HidrawElement *) ed.osReference;
+            if( ref >= & elements.front() && ref <= & elements.back() &&
+               ref->descriptor.sequential == ed.sequential &&
+               ref->descriptor.hidUsage.page == ed.hidUsage.page &&
+               ref->descriptor.hidUsage.usage == ed.hidUsage.usage )
+            {
+                finalElem = ref;
+            }
+        }
+        
+        if( !finalElem )
+        {
+            tUsageMap::iterator e = usageMap.find( ed.hidUsage );
+            if( e != usageMap.end() )
+            {
+                finalElem = e->second;
+            }
+        }
+        
+        if( !finalElem )
+        {
+            tSeqMap::iterator e = seqMap.find( ed.sequential );
+            if( e != seqMap.end() )
+            {
+                finalElem = e->second;
+            }
+        }
+        
+        if( finalElem )
+        {
+            bind( finalElem );
+            if( outVal ) *outVal = values[ finalElem - &elements[0] ];
+            //arrays read 0 or 1 whatever their slots hold
+            if( outMin ) *outMin = finalElem->field.isArray ? 0 : finalElem->field.logicalMin;
+            if( outMax ) *outMax = finalElem->field.isArray ? 1 : finalElem->field.logicalMax;
+            
+            //modify ref
+            ed.osReference = finalElem;
+            return true;
+        }
+        return false;
+    }
+    
+    bool HidrawDeviceDescriptor::evaluateBinding( const ElementBinding & eb , int64_t * outVal )
+    {
+        if( !eb.osReference || elements.empty() ) return false;
+        HidrawElement * ref = (HidrawElement *) eb.osReference;
+        if( ref < & elements.front() || ref > & elements.back() ||
+           ref->field.cookie != eb.cookie ||
+           ref->field.page != eb.page ||
+           ref->field.usage != eb.usage )
+            return false;
+        
+        if( outVal ) *outVal = values[ ref - &elements[0] ];
+        return true;
+    }
+    
+    void HidrawDeviceDescriptor::listElementDescriptors( std::vector<ElementDescriptor> & out )
+    {
+        out.resize( elements.size() );
+        for( size_t i = 0; i < elements.size(); i++ )
+        {
+            out[i] = elements[i].descriptor;
+        }
+    }
+    
+    HidrawManager::HidrawManager( const std::string & deviceDirectory ):
+    deviceDirectory( deviceDirectory )
+    {
+    }
+    
+    HidrawManager::~HidrawManager()
+    {
+        stopInputThread();
+        cleanup();
+    }
+    
+    HidrawDeviceDescriptor * HidrawManager::openDevice( const std::string & path )
+    {
+        int fd = open( path.c_str(), O_RDONLY | O_NONBLOCK );
+        if( fd < 0 ) return 0;
+        
+        int size = 0;
+        struct hidraw_report_descriptor raw;
+        memset( &raw, 0, sizeof( raw ) );
+        HIDReportDescriptor reports;
+        if( ioctl( fd, HIDIOCGRDESCSIZE, &size ) < 0 || size <= 0 || size > HID_MAX_DESCRIPTOR_SIZE )
+        {
+            close( fd );
+            return 0;
+        }
+        raw.size = size;
+        if( ioctl( fd, HIDIOCGRDESC, &raw ) < 0 || !reports.parse( raw.value, raw.size ) )
+        {
+            close( fd );
+            return 0;
+        }
+        
+        //generic desktop joystick, game pad or multi-axis controller
+        bool isJoystick = false;
+        const HIDReportDescriptor::tApplications & apps = reports.getApplications();
+        for( size_t i = 0; i < apps.size() && !isJoystick; i++ )
+        {
+            isJoystick = apps[i].first == 0x01 &&
+                ( apps[i].second == 0x04 || apps[i].second == 0x05 || apps[i].second == 0x08 );
+        }
+        if( !isJoystick )
+        {
+            close( fd );
+            return 0;
+        }
+        
+        char name[256] = "";
+        ioctl( fd, HIDIOCGRAWNAME( sizeof( name ) ), name );
+        
+        struct hidraw_devinfo info;
+        memset( &info, 0, sizeof( info ) );
+        ioctl( fd, HIDIOCGRAWINFO, &info );
+        
+        //ids come back as signed shorts
+        return new HidrawDeviceDescriptor( name, (uint16_t) info.vendor, (uint16_t) info.product, -1,
+                                          fd, path, reports );
+    }
+    
+    static bool compareHidrawNodes( const std::string & a, const std::string & b )
+    {
+        //hidraw2 before hidraw10
+        return atoi( a.c_str() + 6 ) < atoi( b.c_str() + 6 );
+    }
+    
+    void HidrawManager::buildDeviceList()
+    {
+        //watched first, so nodes that appear while scanning are not missed
+        if( !watcher.watch( deviceDirectory, "hidraw" ) )
+            std::cerr << "Could not watch " << deviceDirectory << " for hot plugging" << std::endl;
+        scanDirectory();
+    }
+    
+    void HidrawManager::scanDirectory()
+    {
+        DIR * dir = opendir( deviceDirectory.c_str() );
+        if( !dir ) return;
+        
+        std::vector<std::string> nodes;
+        struct dirent * entry;
+        while( ( entry = readdir( dir ) ) != 0 )
+        {
+            if( strncmp( entry->d_name, "hidraw", 6 ) == 0 )
+                nodes.push_back( entry->d_name );
+        }
+        closedir( dir );
+        
+        std::sort( nodes.begin(), nodes.end(), compareHidrawNodes );
+        
+        for( std::vector<std::string>::iterator n = nodes.begin(); n != nodes.end(); n++ )
+        {
+            plugNode( deviceDirectory + "/" + *n );
+        }
+    }
+    
+    void HidrawManager::plugNode( const std::string & path )
+    {
+        for( tPhysicalDevices::iterator i = mPhysicalDevices.begin(); i != mPhysicalDevices.end(); i++ )
+        {
+            if( static_cast<HidrawDeviceDescriptor*>( *i )->getPath() == path ) return;
+        }
+        
+        HidrawDeviceDescriptor * descriptor = openDevice( path );
+        if( descriptor )
+        {
+            mPhysicalDevices.push_back( descriptor );
+            devicePlugged( descriptor );
+        }
+    }
+    
+    void HidrawManager::unplugNode( const std::string & path )
+    {
+        for( tPhysicalDevices::iterator i = mPhysicalDevices.begin(); i != mPhysicalDevices.end(); i++ )
+        {
+            HidrawDeviceDescriptor * dd = static_cast<HidrawDeviceDescriptor*>( *i );
+            if( dd->getPath() == path )
+            {
+                mPhysicalDevices.erase( i );
+                deviceUnplugged( dd );
+                delete dd;
+                return;
+            }
+        }
+    }
+    
+    void HidrawManager::poll()
+    {
+        //only the nodes that changed, the rest stay bound as they are
+        std::vector<std::string> appeared, removed;
+        if( !watcher.read( appeared, removed ) )
+            scanDirectory();
+        for( std::vector<std::string>::iterator n = removed.begin(); n != removed.end(); n++ )
+        {
+            unplugNode( *n );
+        }
+        for( std::vector<std::string>::iterator n = appeared.begin(); n != appeared.end(); n++ )
+        {
+            plugNode( *n );
+        }
+        
+        for( tPhysicalDevices::iterator i = mPhysicalDevices.begin(); i != mPhysicalDevices.end(); )
+        {
+            HidrawDeviceDescriptor * dd = static_cast<HidrawDeviceDescriptor*>( *i );
+            if( dd->drain() )
+            {
+                i++;
+            }
+            else
+            {
+                deviceUnplugged( dd );
+                delete dd;
+                i = mPhysicalDevices.erase( i );
+            }
+        }
+    }
+    
+    void HidrawManager::cleanup()
+    {
+        for( tPhysicalDevices::iterator i = mPhysicalDevices.begin(); i!=mPhysicalDevices.end(); i++ )
+        {
+            deviceUnplugged( * i );
+            delete *i;
+        }
+        mPhysicalDevices.clear();
+    }
+}
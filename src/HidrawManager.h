@@ -0,0 +1,144 @@
+/*
+ The MIT License (MIT)
+ 
+ Copyright (c) 2013 Juan Borda
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+
+#pragma once
+#include <vector>
+#include <map>
+#include "HIDCollapse.h"
+#include "HIDReportDescriptor.h"
+#include "DeviceNodeWatcher.h"
+
+namespace HIDCollapse
+{
+    /**
+     * A joystick or gamepad read straight from its hidraw node (/dev/hidrawN).
+     * Elements come from the device's own report descriptor, so they carry
+     * the page and usage the device declares, and their values are decoded
+     * from input reports as read() returns them. Their cookies are
+     * HIDReportField's, which are not the ones OSX reports.
+     */
+    class HIDC_EXPORT HidrawDeviceDescriptor: public DeviceDescriptor
+    {
+    public:
+        HidrawDeviceDescriptor( const std::string & name ,
+                               int64_t vendorID, int64_t productID, int64_t versionID ,
+                               int fd , const std::string & path ,
+                               const HIDReportDescriptor & reports );
+        virtual ~HidrawDeviceDescriptor();
+        virtual bool evaluateElementAndUpdateDescriptor( ElementDescriptor & ed ,
+                                                        int64_t * outVal,
+                                                        int64_t * outMin ,
+                                                        int64_t * outMax );
+        virtual bool evaluateBinding( const ElementBinding & eb , int64_t * outVal );
+        
+        virtual void listElementDescriptors( std::vector<ElementDescriptor> & out );
+        
+        //decodes every pending input report without blocking
+        //and reports each change. returns false once the device is gone
+        bool drain();
+        
+        //decodes one input report as read() returns it, id byte included
+        //when the device numbers its reports, and reports what changed.
+        //only elements evaluateElementAndUpdateDescriptor has found are
+        //decoded, through plans compiled when that set changes, and only
+        //from the bytes that differ from the last report of the same id
+        void applyReport( const uint8_t * report , size_t length , uint64_t time );
+        
+        const std::string & getPath() const;
+        
+        int fd;
+        
+    protected:
+        struct HidrawElement
+        {
+            HIDReportField field;
+            ElementDescriptor descriptor;
+        };
+        
+        typedef std::vector<HidrawElement> tElements;
+        typedef std::map<int64_t, HidrawElement*> tSeqMap;
+        typedef std::map<tHIDUsage, HidrawElement*> tUsageMap;
+        
+        //asks the kernel for the current input reports, where it can
+        void readInitialReports();
+        
+        //adds e to what reports decode, with its value as of the last report
+        void bind( HidrawElement * e );
+        void compilePlans();
+        
+        std::string path;
+        
+        //fixed once built, descriptors point into it
+        tElements elements;
+        tSeqMap seqMap;
+        tUsageMap usageMap;
+        
+        //elements of each input report, by report id
+        std::vector< std::vector<HidrawElement*> > reportElements;
+        bool reportIDs;
+        std::vector<uint8_t> readBuffer;
+        
+        //by element, values as of the last report that decoded them
+        std::vector<int32_t> values;
+        std::vector<bool> bound;
+        
+        //by report id, what each decodes and the last one read, id byte excluded
+        std::vector<HIDReportPlan> plans;
+        std::vector< std::vector<uint8_t> > lastReports;
+        bool plansDirty;
+        //decode output, kept for its capacity
+        std::vector<uint32_t> changedElements;
+    };
+    
+    class HIDC_EXPORT HidrawManager: public Manager
+    {
+    public:
+        HidrawManager( const std::string & deviceDirectory = "/dev" );
+        virtual ~HidrawManager();
+        
+    protected:
+        void cleanup();
+        
+        //plugs and unplugs the nodes that came and went since the last poll,
+        //then drains every device's pending reports
+        virtual void poll();
+        
+        //plugs what deviceDirectory holds now and watches it for the rest
+        virtual void buildDeviceList();
+        
+        //plugs every node of deviceDirectory that has no descriptor yet
+        void scanDirectory();
+        //opens path and plugs it, unless a descriptor has it open already
+        void plugNode( const std::string & path );
+        void unplugNode( const std::string & path );
+        
+        //opens path and returns a descriptor if its report descriptor
+        //has a joystick, gamepad or multi-axis controller application
+        HidrawDeviceDescriptor * openDevice( const std::string & path );
+        
+        std::string deviceDirectory;
+        DeviceNodeWatcher watcher;
+    };
+}
@@ -22,11 +22,16 @@
  THE SOFTWARE.
  */
 
+#include <cstdlib>
+#include <new>
+#include <sstream>
+#include <boost/unordered_map.hpp>
 #include "HIDCollapse.h"
+//#include <boost/log/trivial.hpp>
+#define BOOST_LOG_TRIVIAL(which) std::cout
 
 namespace HIDCollapse {
     
-    
     ////////
     /// INDEX
     ////////
@@ -38,50 +43,47 @@ namespace HIDCollapse {
         name = _name;
         physicalDevice = 0;
         deviceMemory = 0;
+        elements = 0;
+        elementCount = 0;
     }
     
     Index::~Index()
     {
         clear();
         delete physicalDevice;
+        delete deviceMemory;
     }
     
     //const access to string indexed fields return null if not present
     IndexedAxis *        Index::getAxis( const std::string & key ) const
     {
-        tStringIndex::const_iterator i = strAxes.find(key);
-        if( i != strAxes.end() )
-            return static_cast<IndexedAxis*> (i->second);
-        else
-            return 0;
+        return layout ? static_cast<IndexedAxis*> ( elementAt( layout->strAxes.find( key ) ) ) : 0;
     }
     
     IndexedButton *     Index::getButton( const std::string & key ) const
     {
-        tStringIndex::const_iterator i = strButtons.find( key );
-        if( i != strButtons.end() )
-            return static_cast<IndexedButton*> (i->second);
-        else
-            return 0;
+        return layout ? static_cast<IndexedButton*> ( elementAt( layout->strButtons.find( key ) ) ) : 0;
     }
     
     //const access to int indexed fields return null if not present
     IndexedAxis *        Index::getAxis( int key ) const
     {
-        tIntIndex::const_iterator i = intAxes.find( key  );
-        if( i != intAxes.end() )
-            return static_cast<IndexedAxis*> (i->second);
-        else
-            return 0;
+        return layout ? static_cast<IndexedAxis*> ( elementAt( layout->intAxes.find( key ) ) ) : 0;
     }
     
     IndexedButton *      Index::getButton( int key ) const
     {
-        tIntIndex::const_iterator i = intButtons.find( key );
-        if( i != intButtons.end() )
-            return static_cast<IndexedButton*> (i->second);
-        else
-            return 0;
+        return layout ? static_cast<IndexedButton*> ( elementAt( layout->intButtons.find( key ) ) ) : 0;
+    }
+    
+    IndexedAxis *        Index::getAxis( const ElementName & key ) const
+    {
+        return layout ? static_cast<IndexedAxis*> ( elementAt( layout->strAxes.find( key ) ) ) : 0;
+    }
+    
+    IndexedButton *      Index::getButton( const ElementName & key ) const
+    {
+        return layout ? static_cast<IndexedButton*> ( elementAt( layout->strButtons.find( key ) ) ) : 0;
     }
     
     DeviceDescriptor * Index::getPhysicalDevice() const
@@ -92,10 +94,16 @@ namespace HIDCollapse {
     void Index::setPhysicalDevice( DeviceDescriptor * dev )
     {
         physicalDevice = dev;
-        if( physicalDevice && allElements.size() <= 0 )
+        //elements are indexed once and never rebuilt, lookups hand them out without locking
+        if( physicalDevice && !layout )
         {
             indexElements( entries );
         }
+        else if( physicalDevice )
+        {
+            //reconnected, element ranges may differ on this device
+            parent->mStateStore.resolveRanges( this );
+        }
     }
     
 
@@ -146,7 +154,7 @@ namespace HIDCollapse {
     
     struct buildIndices : public boost::static_visitor<void>
     {
-        buildIndices( Index::tIntIndex * _intIndex, Index::tStringIndex * _strIndex , IndexedElement * _elem )
+        buildIndices( Index::tIntIndex * _intIndex, Index::tStringIndex * _strIndex , uint32_t _elem )
         {
             intIndex = _intIndex;
             strIndex = _strIndex;
@@ -154,31 +162,29 @@ namespace HIDCollapse {
         }
         Index::tIntIndex * intIndex;
         Index::tStringIndex * strIndex;
-        IndexedElement * elem;
+        uint32_t elem;
         
         void operator()(const std::string & strKey ) const
         {
-            (*strIndex)[strKey] = elem;
+            strIndex->insert( strKey, elem );
         }
         
         void operator()( int intKey ) const
         {
-            (*intIndex)[intKey] = elem;
+            intIndex->insert( intKey, elem );
         }
     };
     
     void  Index::indexElements ( const ast::entries & entries )
     {
         typedef std::vector<ElementDescriptor> tElements;
-        tElements physicalElements;
-        
-        physicalDevice->listElementDescriptors(physicalElements);
+        const tElements & physicalElements = physicalDevice->getElementDescriptors();
         
         /*
         {
             std::cout << "Physical Device " << physicalDevice->getVendorProductCombo() <<
             " lists the following elements: " << std::endl;
-            for( tElements::iterator e = physicalElements.begin() ;
+            for( tElements::const_iterator e = physicalElements.begin() ;
                 e != physicalElements.end() ;
                 e++ )
             {
@@ -188,6 +194,121 @@ namespace HIDCollapse {
         }
         */
         
+        //which elements to bind is worked out once per definition and device model
+        layout = parent->getLayout( entries, *physicalDevice, physicalElements );
+        
+        //element state lives in the manager's store
+        StateStore & store = parent->mStateStore;
+        
+        //one allocation for all of them and their strings, the layout already knows how many
+        if( layout->bindings.empty() ) return;
+        size_t stringBytes = 0;
+        for( IndexLayout::tBindings::const_iterator b = layout->bindings.begin();
+            b != layout->bindings.end();
+            b++ )
+        {
+            stringBytes += IndexedElement::stringBytes( physicalElements[b->physicalElement] );
+        }
+        elements = (char *) malloc( layout->bindings.size() * ELEMENT_SIZE + stringBytes );
+        if( !elements ) return;
+        char * strings = elements + layout->bindings.size() * ELEMENT_SIZE;
+        
+        for( IndexLayout::tBindings::const_iterator b = layout->bindings.begin();
+            b != layout->bindings.end();
+            b++ )
+        {
+            const ElementDescriptor & physicalElement = physicalElements[b->physicalElement];
+            char * at = elements + elementCount * ELEMENT_SIZE;
+            if( b->type == IndexedElement::BUTTON )
+            {
+                new( at ) IndexedButton( this, store, physicalElement, strings );
+            }
+            else
+            {
+                new( at ) IndexedAxis( this, store, physicalElement, strings );
+            }
+            elementCount++;
+        }
+    }
+    
+    static const uint32_t NO_ELEMENT = 0xffffffff;
+    
+    //physical elements by each key strictCompare matches on.
+    //elements sharing a key are chained in listing order
+    struct ElementLookup
+    {
+        typedef boost::unordered_map<std::pair<int64_t, int64_t>, uint32_t> tUsages;
+        typedef boost::unordered_map<std::string, uint32_t> tNames;
+        typedef boost::unordered_map<int64_t, uint32_t> tSequentials;
+        
+        tUsages usages;
+        tNames names;
+        tSequentials sequentials;
+        std::vector<uint32_t> nextUsage, nextName, nextSequential;
+        
+        ElementLookup( const std::vector<ElementDescriptor> & elements ):
+        nextUsage( elements.size(), NO_ELEMENT ),
+        nextName( elements.size(), NO_ELEMENT ),
+        nextSequential( elements.size(), NO_ELEMENT )
+        {
+            //backwards, so each chain starts at the first listed element
+            for( size_t i = elements.size(); i-- > 0; )
+            {
+                const ElementDescriptor & e = elements[i];
+                chain( usages, std::make_pair( e.hidUsage.page, e.hidUsage.usage ), nextUsage, i );
+                if( e.nameKey.size() > 0 )
+                    chain( names, e.nameKey, nextName, i );
+                chain( sequentials, e.sequential, nextSequential, i );
+            }
+        }
+        
+        template< class Map , class Key >
+        static void chain( Map & heads , const Key & key , std::vector<uint32_t> & next , size_t i )
+        {
+            std::pair<typename Map::iterator, bool> r = heads.insert( std::make_pair( key, (uint32_t) i ) );
+            if( !r.second )
+            {
+                next[i] = r.first->second;
+                r.first->second = (uint32_t) i;
+            }
+        }
+        
+        template< class Map , class Key >
+        static uint32_t head( const Map & heads , const Key & key )
+        {
+            typename Map::const_iterator h = heads.find( key );
+            return h == heads.end() ? NO_ELEMENT : h->second;
+        }
+        
+        //first element strictCompare would match to referenced,
+        //the rest follow through *next
+        uint32_t first( const ElementDescriptor & referenced , const std::vector<uint32_t> ** next ) const
+        {
+            if( referenced.hidUsage.page >= 0 && referenced.hidUsage.usage >= 0 )
+            {
+                *next = &nextUsage;
+                return head( usages, std::make_pair( referenced.hidUsage.page, referenced.hidUsage.usage ) );
+            }
+            if( referenced.nameKey.size() > 0 )
+            {
+                *next = &nextName;
+                return head( names, referenced.nameKey );
+            }
+            if( referenced.sequential >= 0 )
+            {
+                *next = &nextSequential;
+                return head( sequentials, referenced.sequential );
+            }
+            return NO_ELEMENT;
+        }
+    };
+    
+    boost::shared_ptr<const IndexLayout> IndexLayout::compile( const ast::entries & entries ,
+                                                              const std::vector<ElementDescriptor> & physicalElements )
+    {
+        boost::shared_ptr<IndexLayout> layout( new IndexLayout );
+        ElementLookup lookup( physicalElements );
+        
         //add each entry in the ast to the index
         for (ast::entries::const_iterator entry = entries.begin();
              entry != entries.end() ;
@@ -198,50 +319,98 @@ namespace HIDCollapse {
             //for now it's just find the one element
             ElementDescriptor referencedElement = boost::apply_visitor( makeElemDesc() , entry->expression.key );
             
-            bool found = false;
-            for( tElements::iterator e = physicalElements.begin() ;
-                e != physicalElements.end() && !found;
-                e++ )
+            //every element strictCompare matches, in listing order
+            const std::vector<uint32_t> * next = 0;
+            for( uint32_t e = lookup.first( referencedElement, &next );
+                e != NO_ELEMENT;
+                e = (*next)[e] )
             {
-                const ElementDescriptor & physicalElement = * e;
-                if( referencedElement.strictCompare( physicalElement ) )
+                Binding binding;
+                //is this element intended for axis or button use?
+                binding.type = boost::apply_visitor(getElementType(), entry->indexTarget);
+                binding.physicalElement = e;
+                
+                uint32_t number = (uint32_t) layout->bindings.size();
+                layout->bindings.push_back( binding );
+                
+                //how is this element accessed?
+                const ast::targetElementKeys & indexKeys = boost::apply_visitor(getIndexKeys(), entry->indexTarget);
+                bool button = binding.type == IndexedElement::BUTTON;
+                
+                //add the element to specified indices
+                for( ast::targetElementKeys::const_iterator key = indexKeys.begin();
+                    key != indexKeys.end();
+                    key++)
                 {
-                    //is this element intended for axis or button use?
-                    IndexedElement::Type type = boost::apply_visitor(getElementType(), entry->indexTarget);
-                    
-                    //how is this element accessed?
-                    const ast::targetElementKeys & indexKeys = boost::apply_visitor(getIndexKeys(), entry->indexTarget);
-
-                    if( type == IndexedElement::BUTTON)
-                    {
-                        IndexedButton * ib = new IndexedButton(this,physicalElement);
-                        
-                        allElements.push_back(ib);
-                        
-                        //add the element to specified indices
-                        for( ast::targetElementKeys::const_iterator key = indexKeys.begin();
-                            key != indexKeys.end();
-                            key++)
-                        {
-                            boost::apply_visitor( buildIndices(&intButtons, &strButtons, ib), *key );
-                        }
-                    }
-                    else if ( type == IndexedElement::ABSOLUTE_AXIS)
-                    {
-                        IndexedAxis * ia = new IndexedAxis( this, physicalElement );
-                        
-                        allElements.push_back(ia);
-                        
-                        for( ast::targetElementKeys::const_iterator key = indexKeys.begin();
-                            key != indexKeys.end();
-                            key++)
-                        {
-                            boost::apply_visitor( buildIndices(&intAxes, &strAxes, ia), *key );
-                        }
-                    }
+                    if( button )
+                        boost::apply_visitor( buildIndices(&layout->intButtons, &layout->strButtons, number), *key );
+                    else
+                        boost::apply_visitor( buildIndices(&layout->intAxes, &layout->strAxes, number), *key );
+                }
+            }
+        }
+        return layout;
+    }
+    
+    std::string IndexLayout::modelKey( const DeviceDescriptor & device ,
+                                      const std::vector<ElementDescriptor> & physicalElements )
+    {
+        //the ids name the model, the elements are what compile actually reads
+        std::ostringstream key;
+        key << device.getVendorID() << ':' << device.getProductID() << ':' << device.getVersionID()
+            << ':' << device.getVendorProductCombo();
+        for( size_t e = 0; e < physicalElements.size(); e++ )
+        {
+            const ElementDescriptor & pe = physicalElements[e];
+            key << '|' << pe.hidUsage.page << ':' << pe.hidUsage.usage << ':' << pe.sequential << ':' << pe.nameKey;
+        }
+        return key.str();
+    }
+    
+    struct collectNames : public boost::static_visitor<void>
+    {
+        collectNames( std::vector<std::string> * _out ):out( _out ){}
+        std::vector<std::string> * out;
+        
+        void operator()( const std::string & strKey ) const
+        {
+            out->push_back( strKey );
+        }
+        
+        void operator()( int ) const
+        {
+        }
+    };
+    
+    bool Index::checkNameHashes( const ast::entries & entries , const std::string & indexName )
+    {
+        typedef std::map<ElementName::tHash, std::string> tSeen;
+        tSeen seen[2];
+        bool ok = true;
+        
+        std::vector<std::string> names;
+        for( ast::entries::const_iterator entry = entries.begin(); entry != entries.end(); entry++ )
+        {
+            IndexedElement::Type type = boost::apply_visitor( getElementType(), entry->indexTarget );
+            const ast::targetElementKeys & keys = boost::apply_visitor( getIndexKeys(), entry->indexTarget );
+            
+            names.clear();
+            for( ast::targetElementKeys::const_iterator key = keys.begin(); key != keys.end(); key++ )
+                boost::apply_visitor( collectNames( &names ), *key );
+            
+            tSeen & typeSeen = seen[ type == IndexedElement::BUTTON ? 0 : 1 ];
+            for( size_t n = 0; n < names.size(); n++ )
+            {
+                std::pair<tSeen::iterator, bool> r = typeSeen.insert( std::make_pair( ElementName::hashOf( names[n] ), names[n] ) );
+                if( !r.second && r.first->second != names[n] )
+                {
+                    BOOST_LOG_TRIVIAL(warning) << "Index \"" << indexName << "\": names \"" << r.first->second << "\" and \""
+                        << names[n] << "\" have the same hash, they will be looked up by string" << std::endl;
+                    ok = false;
                 }
             }
         }
+        return ok;
     }
     
     const std::string & Index::getName()
@@ -261,17 +430,14 @@ namespace HIDCollapse {
     
     void Index::clear()
     {
-        for ( tElements::iterator i = allElements.begin();
-             i != allElements.end();
-             i++)
+        for( uint32_t i = 0; i < elementCount; i++ )
         {
-            delete *i;
+            elementAt( i )->~IndexedElement();
         }
-        allElements.clear();
-        intAxes.clear();
-        intButtons.clear();
-        strAxes.clear();
-        strButtons.clear();
+        free( elements );
+        elements = 0;
+        elementCount = 0;
+        layout.reset();
     }
 
     void Index::rememberDevice( const DeviceDescriptor & dd )
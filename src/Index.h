@@ -26,12 +26,42 @@
 #include <string>
 #include <vector>
 #include <utility>
-#include <map>
+#include <boost/shared_ptr.hpp>
 #include "HIDCollapse.h"
 #include "HIDCollapseParser.h"
 
 namespace HIDCollapse
 {
+    /**
+     * Which physical elements an index definition binds on one model of
+     * device, and under which keys. Compiled once per definition and model,
+     * then shared read only by every Index of that definition on that model.
+     * Each Index keeps only its own elements, numbered as the bindings are.
+     */
+    class HIDC_EXPORT IndexLayout
+    {
+    public:
+        struct Binding
+        {
+            IndexedElement::Type type;
+            //position in the device's listElementDescriptors
+            uint32_t physicalElement;
+        };
+        typedef std::vector<Binding> tBindings;
+        
+        static boost::shared_ptr<const IndexLayout> compile( const ast::entries & entries ,
+                                                            const std::vector<ElementDescriptor> & physicalElements );
+        
+        //devices with the same key get the same layout from the same definition
+        static std::string modelKey( const DeviceDescriptor & device ,
+                                    const std::vector<ElementDescriptor> & physicalElements );
+        
+        tBindings bindings;
+        //keys to positions in bindings
+        IntKeyTable intButtons, intAxes;
+        NameTable strButtons, strAxes;
+    };
+    
     class HIDC_EXPORT Index
     {
     public:
@@ -47,6 +77,14 @@ namespace HIDCollapse
         virtual IndexedAxis *        getAxis( int index ) const ;
         virtual IndexedButton *      getButton( int index ) const ;
         
+        //same as the string versions, found by the name's precomputed hash
+        virtual IndexedAxis *        getAxis( const ElementName & ) const ;
+        virtual IndexedButton *      getButton( const ElementName & ) const ;
+        
+        //reports names of the same type whose hashes collide in entries.
+        //returns false if any do
+        static bool checkNameHashes( const ast::entries & entries , const std::string & indexName );
+        
         DeviceDescriptor * getPhysicalDevice() const;
         void setPhysicalDevice( DeviceDescriptor * );
                 
@@ -54,9 +92,10 @@ namespace HIDCollapse
         int getPlayer();
         void setPlayer( int i );
 
-        typedef std::map<int,IndexedElement*> tIntIndex;
-        typedef std::map<std::string, IndexedElement* > tStringIndex;
+        typedef IntKeyTable tIntIndex;
+        typedef NameTable tStringIndex;
         typedef std::vector<IndexedElement*>tElements;
+        typedef boost::shared_ptr<const IndexLayout> tLayout;
         
         void rememberDevice( const DeviceDescriptor & );
         DeviceDescriptor * recallDevice();
@@ -70,6 +109,15 @@ namespace HIDCollapse
 
         void clear();
         
+        //room for either kind of element
+        static const size_t ELEMENT_SIZE = sizeof( IndexedButton ) > sizeof( IndexedAxis ) ?
+            sizeof( IndexedButton ) : sizeof( IndexedAxis );
+        
+        IndexedElement * elementAt( uint32_t n ) const
+        {
+            return n < elementCount ? (IndexedElement *) ( elements + n * ELEMENT_SIZE ) : 0;
+        }
+        
         friend class Manager;
 
         std::string name;
@@ -78,8 +126,11 @@ namespace HIDCollapse
         DeviceDescriptor * deviceMemory;
         int player;
         
-        tElements allElements;
-        tIntIndex intButtons, intAxes;
-        tStringIndex strButtons, strAxes;
+        //every element of this index, constructed in place in one block
+        //numbered as layout->bindings, followed by their strings.
+        //freed at once by clear()
+        char * elements;
+        uint32_t elementCount;
+        tLayout layout;
     };
 }
\ No newline at end of file
@@ -0,0 +1,179 @@
+/*
+ The MIT License (MIT)
+ 
+ Copyright (c) 2013 Juan Borda
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+
+#include <string.h>
+#include <algorithm>
+#include "HIDCollapse.h"
+
+namespace HIDCollapse
+{
+    const uint32_t IntKeyTable::NONE;
+    const uint32_t NameTable::NONE;
+    
+    static bool compareSparseKeys( const std::pair<int, uint32_t> & a , const std::pair<int, uint32_t> & b )
+    {
+        return a.first < b.first;
+    }
+    
+    void IntKeyTable::insert( int key , uint32_t element )
+    {
+        if( key >= 0 && key < MAX_DIRECT_KEY )
+        {
+            if( (size_t) key >= direct.size() )
+                direct.resize( key + 1, NONE );
+            direct[key] = element;
+            return;
+        }
+        
+        tSparseEntry e( key, element );
+        std::vector<tSparseEntry>::iterator i = std::lower_bound( sparse.begin(), sparse.end(), e, compareSparseKeys );
+        if( i != sparse.end() && i->first == key )
+            i->second = element;
+        else
+            sparse.insert( i, e );
+    }
+    
+    uint32_t IntKeyTable::findSparse( int key ) const
+    {
+        tSparseEntry e( key, NONE );
+        std::vector<tSparseEntry>::const_iterator i = std::lower_bound( sparse.begin(), sparse.end(), e, compareSparseKeys );
+        if( i != sparse.end() && i->first == key )
+            return i->second;
+        return NONE;
+    }
+    
+    void IntKeyTable::clear()
+    {
+        direct.clear();
+        sparse.clear();
+    }
+    
+    NameTable::NameTable():count( 0 )
+    {
+    }
+    
+    bool NameTable::sameName( const Entry & e , const char * name , size_t length ) const
+    {
+        return e.length == length && memcmp( nameOf( e ), name, length ) == 0;
+    }
+    
+    const NameTable::Entry * NameTable::lookup( ElementName::tHash hash , const char * name , size_t length ) const
+    {
+        if( entries.empty() ) return 0;
+        
+        size_t mask = entries.size() - 1;
+        for( size_t i = hash & mask; entries[i].element != NONE; i = ( i + 1 ) & mask )
+        {
+            const Entry & e = entries[i];
+            if( e.hash == hash && ( !name || sameName( e, name, length ) ) )
+                return & e;
+        }
+        return 0;
+    }
+    
+    uint32_t NameTable::find( const std::string & name ) const
+    {
+        const Entry * e = lookup( ElementName::hashOf( name ), name.data(), name.size() );
+        return e ? e->element : NONE;
+    }
+    
+    uint32_t NameTable::find( const ElementName & name ) const
+    {
+        //the first entry of that hash settles it unless the hash is shared
+        const Entry * e = lookup( name.getHash(), 0, 0 );
+        if( e && e->collided )
+            e = lookup( name.getHash(), name.str().data(), name.str().size() );
+        return e ? e->element : NONE;
+    }
+    
+    bool NameTable::place( std::vector<Entry> & table , const Entry & e )
+    {
+        size_t mask = table.size() - 1;
+        size_t i = e.hash & mask;
+        bool shared = false;
+        for( ; table[i].element != NONE; i = ( i + 1 ) & mask )
+        {
+            Entry & existing = table[i];
+            if( existing.hash != e.hash ) continue;
+            
+            if( existing.length == e.length && memcmp( nameOf( existing ), nameOf( e ), e.length ) == 0 )
+            {
+                existing.element = e.element;
+                return false;
+            }
+            existing.collided = 1;
+            shared = true;
+        }
+        
+        table[i] = e;
+        if( shared ) table[i].collided = 1;
+        return true;
+    }
+    
+    void NameTable::grow()
+    {
+        std::vector<Entry> bigger( entries.empty() ? 16 : entries.size() * 2 );
+        for( size_t i = 0; i < bigger.size(); i++ ) bigger[i].element = NONE;
+        for( size_t i = 0; i < entries.size(); i++ )
+        {
+            if( entries[i].element != NONE ) place( bigger, entries[i] );
+        }
+        entries.swap( bigger );
+    }
+    
+    void NameTable::insert( const std::string & name , uint32_t element )
+    {
+        if( element == NONE ) return;
+        //keep at most half full
+        if( ( count + 1 ) * 2 > entries.size() ) grow();
+        
+        Entry e;
+        memset( &e, 0, sizeof( e ) );
+        e.element = element;
+        e.hash = ElementName::hashOf( name );
+        e.length = (uint16_t) std::min( name.size(), (size_t) 0xffff );
+        if( e.length < SHORT_NAME )
+        {
+            memcpy( e.shortName, name.data(), e.length );
+        }
+        else
+        {
+            e.longName = (uint32_t) longNames.size();
+            longNames.insert( longNames.end(), name.data(), name.data() + e.length );
+        }
+        
+        if( place( entries, e ) )
+            count++;
+        else if( e.length >= SHORT_NAME )
+            longNames.resize( e.longName );
+    }
+    
+    void NameTable::clear()
+    {
+        entries.clear();
+        longNames.clear();
+        count = 0;
+    }
+}
@@ -0,0 +1,127 @@
+/*
+ The MIT License (MIT)
+ 
+ Copyright (c) 2013 Juan Borda
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <utility>
+#include "HIDCollapse.h"
+
+namespace HIDCollapse
+{
+    /**
+     * Element numbers by the integer keys of a config.
+     * Those are small and dense, so they index a plain array.
+     * Negative or very large keys go to a sorted side table.
+     */
+    class HIDC_EXPORT IntKeyTable
+    {
+    public:
+        //keys below this are looked up directly
+        static const int MAX_DIRECT_KEY = 1024;
+        
+        //what find returns for keys that are not there
+        static const uint32_t NONE = 0xffffffff;
+        
+        //replaces any element already under key
+        void insert( int key , uint32_t element );
+        
+        uint32_t find( int key ) const
+        {
+            if( (unsigned) key < direct.size() )
+                return direct[key];
+            return sparse.empty() ? NONE : findSparse( key );
+        }
+        
+        void clear();
+        
+    private:
+        uint32_t findSparse( int key ) const;
+        
+        std::vector<uint32_t> direct;
+        typedef std::pair<int, uint32_t> tSparseEntry;
+        std::vector<tSparseEntry> sparse;
+    };
+    
+    /**
+     * Element numbers by the string keys of a config, in an open addressing
+     * table keyed by ElementName hashes with linear probing.
+     * Short names are stored inline in their entry, longer ones
+     * in one buffer shared by the table.
+     * Lookups through an ElementName only compare hashes unless
+     * that hash is shared by two names of the table.
+     */
+    class HIDC_EXPORT NameTable
+    {
+    public:
+        NameTable();
+        
+        //what find returns for names that are not there
+        static const uint32_t NONE = 0xffffffff;
+        
+        //replaces any element already under name
+        void insert( const std::string & name , uint32_t element );
+        
+        uint32_t find( const std::string & name ) const;
+        uint32_t find( const ElementName & name ) const;
+        
+        void clear();
+        size_t size() const { return count; }
+        
+    private:
+        //fills Entry up to 32 bytes
+        static const size_t SHORT_NAME = 21;
+        
+        struct Entry
+        {
+            uint32_t element;           //NONE while the entry is free
+            ElementName::tHash hash;
+            uint16_t length;
+            uint8_t collided;
+            union
+            {
+                char shortName[SHORT_NAME];
+                uint32_t longName;      //offset in longNames
+            };
+        };
+        
+        const char * nameOf( const Entry & e ) const
+        {
+            return e.length < SHORT_NAME ? e.shortName : & longNames[ e.longName ];
+        }
+        bool sameName( const Entry & e , const char * name , size_t length ) const;
+        const Entry * lookup( ElementName::tHash hash , const char * name , size_t length ) const;
+        
+        //places e, marking entries of the same hash as collided.
+        //returns false if an entry of the same name was updated instead
+        bool place( std::vector<Entry> & table , const Entry & e );
+        void grow();
+        
+        std::vector<Entry> entries;     //power of two sized
+        std::vector<char> longNames;
+        size_t count;
+    };
+}
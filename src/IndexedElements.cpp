@@ -22,14 +22,31 @@
  THE SOFTWARE.
  */
 
+#include <cstring>
 #include "HIDCollapse.h"
 
 namespace HIDCollapse
 {
     
-    IndexedElement::IndexedElement( Index * parent ,  const ElementDescriptor & physicalElement ):
-    parent(parent),physicalElement(physicalElement)
+    static const char * copyString( const std::string & s , char *& strings )
     {
+        const char * copy = strings;
+        memcpy( strings, s.c_str(), s.size() + 1 );
+        strings += s.size() + 1;
+        return copy;
+    }
+    
+    IndexedElement::IndexedElement( Index * parent , const StateStore * store , const ElementDescriptor & physicalElement , char *& strings ):
+    parent(parent),store(store),slot(StateStore::INVALID_SLOT),
+    hidUsage(physicalElement.hidUsage),sequential(physicalElement.sequential),osReference(physicalElement.osReference)
+    {
+        usageString = copyString( physicalElement.usageString, strings );
+        nameKey = copyString( physicalElement.nameKey, strings );
+    }
+    
+    size_t IndexedElement::stringBytes( const ElementDescriptor & physicalElement )
+    {
+        return physicalElement.usageString.size() + 1 + physicalElement.nameKey.size() + 1;
     }
     
     IndexedElement::~IndexedElement()
@@ -41,16 +58,26 @@ namespace HIDCollapse
         return parent;
     }
     
-    const ElementDescriptor & IndexedElement::getPhysicalElement()const
+    ElementDescriptor IndexedElement::getPhysicalElement()const
     {
+        ElementDescriptor physicalElement( hidUsage.page, hidUsage.usage );
+        physicalElement.usageString = usageString;
+        physicalElement.nameKey = nameKey;
+        physicalElement.sequential = sequential;
+        physicalElement.osReference = osReference;
         return physicalElement;
     }
+    
+    StateStore::tSlot IndexedElement::getSlot() const
+    {
+        return slot;
+    }
 
 
-    IndexedButton::IndexedButton( Index * parent , const ElementDescriptor & physicalElement ):
-    IndexedElement( parent, physicalElement )
+    IndexedButton::IndexedButton( Index * parent , StateStore & store , const ElementDescriptor & physicalElement , char *& strings ):
+    IndexedElement( parent, &store, physicalElement, strings )
     {
-        parent->getPhysicalDevice();
+        slot = store.addButton( parent, this );
     }
     
     IndexedButton::~IndexedButton()
@@ -65,21 +92,28 @@ namespace HIDCollapse
     
     bool IndexedButton::isPressed()
     {
-        DeviceDescriptor * pd = parent->getPhysicalDevice();
-        if( pd )
-        {
-            int64_t val, min;
-            if( pd->evaluateElementAndUpdateDescriptor( physicalElement , &val, &min, 0 ) )
-            {
-                return ( val > min );
-            }
-        }
-        return false;
+        return store->isPressed( slot );
+    }
+    
+    bool IndexedButton::wasPressedThisFrame()
+    {
+        return store->wasPressed( slot );
+    }
+    
+    bool IndexedButton::wasReleasedThisFrame()
+    {
+        return store->wasReleased( slot );
+    }
+    
+    uint32_t IndexedButton::getHeldFrames()
+    {
+        return store->getHeldFrames( slot );
     }
     
-    IndexedAxis::IndexedAxis( Index * parent , const ElementDescriptor & physicalElement ):
-    IndexedElement( parent, physicalElement )
+    IndexedAxis::IndexedAxis( Index * parent , StateStore & store , const ElementDescriptor & physicalElement , char *& strings ):
+    IndexedElement( parent, &store, physicalElement, strings )
     {
+        slot = store.addAxis( parent, this );
     }
     
     IndexedAxis::~IndexedAxis()
@@ -95,61 +129,23 @@ namespace HIDCollapse
     
     int64_t IndexedAxis::getIntValue()
     {
-        DeviceDescriptor * pd = parent->getPhysicalDevice();
-        if( pd )
-        {
-            int64_t val;
-            if( pd->evaluateElementAndUpdateDescriptor( physicalElement , &val, 0 , 0 ) )
-            {
-                return val;
-            }
-        }
-        return 0;
+        return store->getAxisRaw( slot );
     }
     
     int64_t IndexedAxis::getIntMax()
     {
-        DeviceDescriptor * pd = parent->getPhysicalDevice();
-        if( pd )
-        {
-            int64_t max;
-            if( pd->evaluateElementAndUpdateDescriptor( physicalElement , 0 , 0 , &max ) )
-            {
-                return max;
-            }
-        }
-        return 0;
+        return store->getAxisMax( slot );
     }
     
     int64_t IndexedAxis::getIntMin()
     {
-        DeviceDescriptor * pd = parent->getPhysicalDevice();
-        if( pd )
-        {
-            int64_t min;
-            if( pd->evaluateElementAndUpdateDescriptor( physicalElement , 0 , &min , 0 ) )
-            {
-                return min;
-            }
-        }
-        return 0;
+        return store->getAxisMin( slot );
     }
 
     //0..1
     double IndexedAxis::getNormalizedValue()
     {
-        DeviceDescriptor * pd = parent->getPhysicalDevice();
-        if( pd )
-        {
-            int64_t val, min, max;
-            if( pd->evaluateElementAndUpdateDescriptor( physicalElement , &val , &min , &max ) )
-            {
-                int64_t max_min = max-min;
-                if( max_min == 0 ) return 0;
-                return (val - min)/(float) max_min;
-            }
-        }
-        return 0.0;
+        return store->getAxisNormalized( slot );
     }
     //-1..1
     double IndexedAxis::getScaledValue()
@@ -43,12 +43,37 @@ namespace HIDCollapse
         
         virtual Type getType() const = 0;
         virtual Index * getParent() const ;
-        virtual const ElementDescriptor & getPhysicalElement()const;
+        
+        //a copy of the physical element it reads, built on demand. the input
+        //thread refreshes its osReference when the element moves, call it
+        //under a Manager::DeviceLock
+        virtual ElementDescriptor getPhysicalElement()const;
+        
+        //room physicalElement's strings take in the Index's block
+        static size_t stringBytes( const ElementDescriptor & physicalElement );
+        
+        //where this element's state lives in the Manager's StateStore,
+        //what InputEvents for it carry
+        StateStore::tSlot getSlot() const;
         
     protected:
-        IndexedElement( Index * parent , const ElementDescriptor & physicalElement );
+        //copies physicalElement's strings to strings and moves it past them
+        IndexedElement( Index * parent , const StateStore * store , const ElementDescriptor & physicalElement , char *& strings );
+        friend class StateStore;
         Index * parent;
-        ElementDescriptor physicalElement;
+        
+        //where this element's state is captured
+        const StateStore * store;
+        StateStore::tSlot slot;
+        
+        //what the store's binding was made from, kept in the Index's one block
+        //rather than in per slot arrays that grow on hot plug. the strings
+        //sit after the elements so an element costs no allocations of its own
+        tHIDUsage hidUsage;
+        int64_t sequential;
+        void * osReference;
+        const char * usageString;
+        const char * nameKey;
     };
     
     
@@ -56,22 +81,30 @@ namespace HIDCollapse
     {
     public:
 
-        IndexedButton( Index * parent , const ElementDescriptor & physicalElement );
+        //takes a slot of store for physicalElement
+        IndexedButton( Index * parent , StateStore & store , const ElementDescriptor & physicalElement , char *& strings );
         virtual ~IndexedButton();
         virtual Type getType()const ;
         bool isPressed() ;
         
+        //changes between the last two Manager::capture() calls
+        bool wasPressedThisFrame();
+        bool wasReleasedThisFrame();
+        
+        //captures in a row the button has been down for, including the last one
+        uint32_t getHeldFrames();
+        
     protected:
     };
     
     class HIDC_EXPORT IndexedAxis: public IndexedElement
     {
     public:
-        IndexedAxis( Index * parent , const ElementDescriptor & physicalElement );
+        IndexedAxis( Index * parent , StateStore & store , const ElementDescriptor & physicalElement , char *& strings );
         virtual ~IndexedAxis() ;
         virtual Type getType()const;
         
-        //try not to use these as they 
+        //values as of the last Manager::capture()
         int64_t getIntValue();
         int64_t getIntMax();
         int64_t getIntMin();
@@ -0,0 +1,612 @@
+/*
+ The MIT License (MIT)
+ 
+ Copyright (c) 2013 Juan Borda
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include <linux/input.h>
+#include <sys/ioctl.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <algorithm>
+
+#include "LinuxManager.h"
+
+#define BITS_PER_LONG ( sizeof(unsigned long) * 8 )
+#define NBITS( x ) ( ( ( x ) - 1 ) / BITS_PER_LONG + 1 )
+#define TEST_BIT( bit , array ) ( ( array[ ( bit ) / BITS_PER_LONG ] >> ( ( bit ) % BITS_PER_LONG ) ) & 1 )
+
+//newer headers stop exposing ev.time where time_t is 64 bits on 32 bit systems
+#if defined( input_event_sec )
+#define EVENT_MICROSECONDS( ev ) ( (uint64_t) ( ev ).input_event_sec * 1000000 + ( ev ).input_event_usec )
+#else
+#define EVENT_MICROSECONDS( ev ) ( (uint64_t) ( ev ).time.tv_sec * 1000000 + ( ev ).time.tv_usec )
+#endif
+
+namespace HIDCollapse
+{
+    //not an evdev type. the first hat is also reported as a single
+    //HID hat switch synthesized from ABS_HAT0X/ABS_HAT0Y
+    static const int EV_HAT_SWITCH = 0x100;
+    static const int HAT_CENTERED = 8;
+    
+    LinuxDeviceDescriptor::LinuxDeviceDescriptor( const std::string & name ,
+                                                 int64_t vendorID, int64_t productID, int64_t versionID ,
+                                                 int fd , const std::string & path ):
+    DeviceDescriptor( vendorID, productID, versionID ),
+    fd( fd ),
+    path( path ),
+    keyValues( KEY_CNT , 0 ),
+    absValues( ABS_CNT , 0 ),
+    keyElements( KEY_CNT , (LinuxElement*) 0 ),
+    absElements( ABS_CNT , (LinuxElement*) 0 ),
+    hatElement( 0 ),
+    monotonicTimestamps( false ),
+    dropping( false )
+    {
+        setVendorProductCombo( name );
+        
+        //the serial or bluetooth address, else the usb port path
+        char uniq[256] = "", phys[256] = "";
+        if( fd >= 0 )
+        {
+            ioctl( fd, EVIOCGUNIQ( sizeof( uniq ) ), uniq );
+            ioctl( fd, EVIOCGPHYS( sizeof( phys ) ), phys );
+        }
+        setIdentity( uniq, phys );
+        
+        //same clock as monotonicMicroseconds(), the kernel defaults to CLOCK_REALTIME
+#if defined( EVIOCSCLOCKID )
+        int clock = CLOCK_MONOTONIC;
+        monotonicTimestamps = ioctl( fd, EVIOCSCLOCKID, &clock ) == 0;
+#endif
+        
+        enumerateElements();
+        resync();
+    }
+    
+    LinuxDeviceDescriptor::~LinuxDeviceDescriptor()
+    {
+        if( fd >= 0 )
+        {
+            close( fd );
+        }
+    }
+    
+    const std::string & LinuxDeviceDescriptor::getPath() const
+    {
+        return path;
+    }
+    
+    void LinuxDeviceDescriptor::enumerateElements()
+    {
+        unsigned long keyBits[ NBITS( KEY_CNT ) ];
+        unsigned long absBits[ NBITS( ABS_CNT ) ];
+        memset( keyBits, 0, sizeof( keyBits ) );
+        memset( absBits, 0, sizeof( absBits ) );
+        
+        ioctl( fd, EVIOCGBIT( EV_KEY, sizeof( keyBits ) ), keyBits );
+        ioctl( fd, EVIOCGBIT( EV_ABS, sizeof( absBits ) ), absBits );
+        
+        //count first so the vector never reallocates under the maps
+        size_t count = 0;
+        for( int code = 0; code < KEY_CNT; code++ )
+            if( TEST_BIT( code, keyBits ) ) count++;
+        for( int code = 0; code < ABS_CNT; code++ )
+            if( TEST_BIT( code, absBits ) ) count++;
+        elements.reserve( count + 1 );
+        
+        for( int code = BTN_MISC; code < KEY_CNT; code++ )
+        {
+            if( TEST_BIT( code, keyBits ) )
+                addElement( EV_KEY, code, 0, 1 );
+        }
+        
+        for( int code = 0; code < ABS_CNT; code++ )
+        {
+            if( TEST_BIT( code, absBits ) )
+            {
+                struct input_absinfo info;
+                if( ioctl( fd, EVIOCGABS( code ), &info ) >= 0 )
+                    addElement( EV_ABS, code, info.minimum, info.maximum );
+            }
+        }
+        
+        if( TEST_BIT( ABS_HAT0X, absBits ) && TEST_BIT( ABS_HAT0Y, absBits ) )
+        {
+            addElement( EV_HAT_SWITCH, ABS_HAT0X, 0, 7 );
+        }
+    }
+    
+    void LinuxDeviceDescriptor::addElement( int type, int code, int64_t min, int64_t max )
+    {
+        LinuxElement e;
+        e.type = type;
+        e.code = code;
+        e.min = min;
+        e.max = max;
+        
+        tHIDUsage usage( -1, -1 );
+        if( type == EV_HAT_SWITCH )
+        {
+            usage.page = 0x01;
+            usage.usage = 0x39;
+        }
+        else if( type == EV_KEY )
+            usageForKey( code, usage );
+        else
+            usageForAbs( code, usage );
+        
+        e.descriptor.hidUsage = usage;
+        e.descriptor.sequential = elements.size();
+        e.descriptor.nameKey = nameForCode( type, code );
+        elements.push_back( e );
+        
+        LinuxElement * ref = & elements.back();
+        ref->descriptor.osReference = ref;
+        
+        if( type == EV_HAT_SWITCH ) hatElement = ref;
+        else if( type == EV_KEY ) keyElements[code] = ref;
+        else absElements[code] = ref;
+        
+        if( usage.page >= 0 && usageMap.find( usage ) == usageMap.end() )
+        {
+            usageMap[usage] = ref;
+        }
+        nameMap[ref->descriptor.nameKey] = ref;
+        seqMap[ref->descriptor.sequential] = ref;
+    }
+    
+    //inverse of the kernel's hid-input mapping for joystick and gamepad buttons:
+    //HID buttons 1..16 become BTN_JOYSTICK+n or BTN_GAMEPAD+n, the rest BTN_TRIGGER_HAPPY+n
+    bool LinuxDeviceDescriptor::usageForKey( int code , tHIDUsage & out )
+    {
+        if( code >= BTN_JOYSTICK && code < BTN_JOYSTICK + 0x10 )
+        {
+            out.page = 0x09;
+            out.usage = code - BTN_JOYSTICK + 1;
+            return true;
+        }
+        if( code >= BTN_GAMEPAD && code < BTN_GAMEPAD + 0x10 )
+        {
+            out.page = 0x09;
+            out.usage = code - BTN_GAMEPAD + 1;
+            return true;
+        }
+        if( code >= BTN_TRIGGER_HAPPY && code <= BTN_TRIGGER_HAPPY40 )
+        {
+            out.page = 0x09;
+            out.usage = code - BTN_TRIGGER_HAPPY + 0x11;
+            return true;
+        }
+        return false;
+    }
+    
+    //inverse of hid-input for absolute axes
+    bool LinuxDeviceDescriptor::usageForAbs( int code , tHIDUsage & out )
+    {
+        //generic desktop X..Wheel map to ABS_X..ABS_WHEEL in order
+        if( code >= ABS_X && code <= ABS_WHEEL )
+        {
+            out.page = 0x01;
+            out.usage = 0x30 + code;
+            return true;
+        }
+        //simulation controls
+        if( code == ABS_GAS )
+        {
+            out.page = 0x02;
+            out.usage = 0xc4;
+            return true;
+        }
+        if( code == ABS_BRAKE )
+        {
+            out.page = 0x02;
+            out.usage = 0xc5;
+            return true;
+        }
+        return false;
+    }
+    
+    std::string LinuxDeviceDescriptor::nameForCode( int type , int code )
+    {
+        static const char * absNames[] = {
+            "ABS_X", "ABS_Y", "ABS_Z", "ABS_RX", "ABS_RY", "ABS_RZ",
+            "ABS_THROTTLE", "ABS_RUDDER", "ABS_WHEEL", "ABS_GAS", "ABS_BRAKE" };
+        static const char * hatNames[] = {
+            "ABS_HAT0X", "ABS_HAT0Y", "ABS_HAT1X", "ABS_HAT1Y",
+            "ABS_HAT2X", "ABS_HAT2Y", "ABS_HAT3X", "ABS_HAT3Y" };
+        static const char * btnNames[] = {
+            "BTN_TRIGGER", "BTN_THUMB", "BTN_THUMB2", "BTN_TOP", "BTN_TOP2", "BTN_PINKIE",
+            "BTN_BASE", "BTN_BASE2", "BTN_BASE3", "BTN_BASE4", "BTN_BASE5", "BTN_BASE6",
+            0, 0, 0, "BTN_DEAD",
+            "BTN_SOUTH", "BTN_EAST", "BTN_C", "BTN_NORTH", "BTN_WEST", "BTN_Z",
+            "BTN_TL", "BTN_TR", "BTN_TL2", "BTN_TR2", "BTN_SELECT", "BTN_START",
+            "BTN_MODE", "BTN_THUMBL", "BTN_THUMBR", 0 };
+        
+        if( type == EV_HAT_SWITCH )
+            return "HAT_SWITCH";
+        
+        const char * name = 0;
+        if( type == EV_ABS )
+        {
+            if( code <= ABS_BRAKE ) name = absNames[code];
+            else if( code >= ABS_HAT0X && code <= ABS_HAT3Y ) name = hatNames[ code - ABS_HAT0X ];
+        }
+        else if( code >= BTN_JOYSTICK && code < BTN_DIGI )
+        {
+            name = btnNames[ code - BTN_JOYSTICK ];
+        }
+        
+        if( name ) return name;
+        
+        char buff[32];
+        snprintf( buff, sizeof( buff ), "%s_0x%x", type == EV_ABS ? "ABS" : "BTN", code );
+        return buff;
+    }
+    
+    void LinuxDeviceDescriptor::resync()
+    {
+        unsigned long keyState[ NBITS( KEY_CNT ) ];
+        memset( keyState, 0, sizeof( keyState ) );
+        ioctl( fd, EVIOCGKEY( sizeof( keyState ) ), keyState );
+        
+        //whatever changed in the events lost happened by now
+        uint64_t now = monotonicMicroseconds();
+        int64_t hatBefore = hatElement ? currentValue( *hatElement ) : 0;
+        
+        for( tElements::iterator e = elements.begin(); e != elements.end(); e++ )
+        {
+            int64_t before = currentValue( *e );
+            if( e->type == EV_KEY )
+            {
+                keyValues[e->code] = TEST_BIT( e->code, keyState );
+            }
+            else if( e->type == EV_ABS )
+            {
+                struct input_absinfo info;
+                if( ioctl( fd, EVIOCGABS( e->code ), &info ) >= 0 )
+                    absValues[e->code] = info.value;
+            }
+            else continue;
+            reportIfChanged( &*e, before, now );
+        }
+        
+        if( hatElement ) reportIfChanged( hatElement, hatBefore, now );
+    }
+    
+    void LinuxDeviceDescriptor::reportIfChanged( LinuxElement * e , int64_t before , uint64_t time )
+    {
+        if( e && currentValue( *e ) != before )
+            reportChange( e, currentValue( *e ), time );
+    }
+    
+    bool LinuxDeviceDescriptor::drain()
+    {
+        struct input_event events[64];
+        
+        while( true )
+        {
+            ssize_t bytes = read( fd, events, sizeof( events ) );
+            if( bytes < 0 )
+            {
+                if( errno == EINTR ) continue;
+                //nothing pending
+                if( errno == EAGAIN ) return true;
+                //ENODEV and friends, device is gone
+                return false;
+            }
+            if( bytes == 0 ) return false;
+            
+            size_t count = bytes / sizeof( struct input_event );
+            uint64_t readTime = monotonicTimestamps ? 0 : monotonicMicroseconds();
+            for( size_t i = 0; i < count; i++ )
+            {
+                const struct input_event & ev = events[i];
+                uint64_t time = monotonicTimestamps ? EVENT_MICROSECONDS( ev ) : readTime;
+                
+                if( dropping )
+                {
+                    if( ev.type == EV_SYN && ev.code == SYN_REPORT )
+                    {
+                        dropping = false;
+                        resync();
+                    }
+                }
+                else if( ev.type == EV_KEY && ev.code < KEY_CNT )
+                {
+                    int64_t before = keyValues[ev.code] ? 1 : 0;
+                    keyValues[ev.code] = ev.value;
+                    reportIfChanged( keyElements[ev.code], before, time );
+                }
+                else if( ev.type == EV_ABS && ev.code < ABS_CNT )
+                {
+                    bool hat = hatElement && ( ev.code == ABS_HAT0X || ev.code == ABS_HAT0Y );
+                    int64_t hatBefore = hat ? currentValue( *hatElement ) : 0;
+                    int64_t before = absValues[ev.code];
+                    absValues[ev.code] = ev.value;
+                    reportIfChanged( absElements[ev.code], before, time );
+                    if( hat ) reportIfChanged( hatElement, hatBefore, time );
+                }
+                else if( ev.type == EV_SYN && ev.code == SYN_DROPPED )
+                    dropping = true;
+            }
+            
+            if( count < sizeof( events ) / sizeof( events[0] ) ) return true;
+        }
+    }
+    
+    int64_t LinuxDeviceDescriptor::currentValue( const LinuxElement & e ) const
+    {
+        if( e.type == EV_KEY )
+            return keyValues[e.code] ? 1 : 0;
+        if( e.type == EV_ABS )
+            return absValues[e.code];
+        
+        //hat switch, clockwise from north like HID
+        int x = absValues[ABS_HAT0X], y = absValues[ABS_HAT0Y];
+        if( y < 0 ) return x < 0 ? 7 : ( x > 0 ? 1 : 0 );
+        if( y > 0 ) return x < 0 ? 5 : ( x > 0 ? 3 : 4 );
+        if( x > 0 ) return 2;
+        if( x < 0 ) return 6;
+        return HAT_CENTERED;
+    }
+    
+    bool LinuxDeviceDescriptor::evaluateElementAndUpdateDescriptor( ElementDescriptor & ed ,
+                                                                   int64_t * outVal ,
+                                                                   int64_t * outMin ,
+                                                                   int64_t * outMax )
+    {
+        LinuxElement * finalElem = 0;
+        
+        //trust the reference only if it is one of ours and still describes the same element
+        if( ed.osReference && !elements.empty() )
+        {
+            LinuxElement * ref = (LinuxElement *) ed.osReference;
+            if( ref >= & elements.front() && ref <= & elements.back() &&
+               ref->descriptor.sequential == ed.sequential &&
+               ref->descriptor.hidUsage.page == ed.hidUsage.page &&
+               ref->descriptor.hidUsage.usage == ed.hidUsage.usage )
+            {
+                finalElem = ref;
+            }
+        }
+        
+        if( !finalElem )
+        {
+            tUsageMap::iterator e = usageMap.find( ed.hidUsage );
+            if( e != usageMap.end() )
+            {
+                finalElem = e->second;
+            }
+        }
+        
+        if( !finalElem )
+        {
+            tStrMap::iterator e = nameMap.find( ed.nameKey );
+            if( e != nameMap.end() )
+            {
+                finalElem = e->second;
+            }
+        }
+        
+        if( !finalElem )
+        {
+            tSeqMap::iterator e = seqMap.find( ed.sequential );
+            if( e != seqMap.end() )
+            {
+                finalElem = e->second;
+            }
+        }
+        
+        if( finalElem )
+        {
+            if( outVal ) *outVal = currentValue( *finalElem );
+            if( outMin ) *outMin = finalElem->min;
+            if( outMax ) *outMax = finalElem->max;
+            
+            //modify ref
+            ed.osReference = finalElem;
+            return true;
+        }
+        return false;
+    }
+    
+    bool LinuxDeviceDescriptor::evaluateBinding( const ElementBinding & eb , int64_t * outVal )
+    {
+        if( !eb.osReference || elements.empty() ) return false;
+        LinuxElement * ref = (LinuxElement *) eb.osReference;
+        if( ref < & elements.front() || ref > & elements.back() ||
+           (uint32_t) ref->descriptor.sequential != eb.cookie ||
+           (uint16_t) ref->descriptor.hidUsage.page != eb.page ||
+           (uint16_t) ref->descriptor.hidUsage.usage != eb.usage )
+            return false;
+        
+        if( outVal ) *outVal = currentValue( *ref );
+        return true;
+    }
+    
+    void LinuxDeviceDescriptor::listElementDescriptors( std::vector<ElementDescriptor> & out )
+    {
+        out.resize( elements.size() );
+        for( size_t i = 0; i < elements.size(); i++ )
+        {
+            out[i] = elements[i].descriptor;
+        }
+    }
+    
+    LinuxManager::LinuxManager( const std::string & inputDirectory ):
+    inputDirectory( inputDirectory )
+    {
+    }
+    
+    LinuxManager::~LinuxManager()
+    {
+        stopInputThread();
+        cleanup();
+    }
+    
+    LinuxDeviceDescriptor * LinuxManager::openDevice( const std::string & path )
+    {
+        int fd = open( path.c_str(), O_RDONLY | O_NONBLOCK );
+        if( fd < 0 ) return 0;
+        
+        //joysticks and gamepads are what has joystick or gamepad buttons,
+        //same test udev uses for ID_INPUT_JOYSTICK
+        unsigned long keyBits[ NBITS( KEY_CNT ) ];
+        memset( keyBits, 0, sizeof( keyBits ) );
+        ioctl( fd, EVIOCGBIT( EV_KEY, sizeof( keyBits ) ), keyBits );
+        
+        bool isJoystick = false;
+        for( int code = BTN_JOYSTICK; code < BTN_DIGI && !isJoystick; code++ )
+            isJoystick = TEST_BIT( code, keyBits );
+        for( int code = BTN_TRIGGER_HAPPY; code <= BTN_TRIGGER_HAPPY40 && !isJoystick; code++ )
+            isJoystick = TEST_BIT( code, keyBits );
+        
+        if( !isJoystick )
+        {
+            close( fd );
+            return 0;
+        }
+        
+        char name[256] = "";
+        ioctl( fd, EVIOCGNAME( sizeof( name ) ), name );
+        
+        struct input_id id;
+        memset( &id, 0, sizeof( id ) );
+        ioctl( fd, EVIOCGID, &id );
+        
+        return new LinuxDeviceDescriptor( name, id.vendor, id.product, id.version, fd, path );
+    }
+    
+    static bool compareEventNodes( const std::string & a, const std::string & b )
+    {
+        //event2 before event10
+        return atoi( a.c_str() + 5 ) < atoi( b.c_str() + 5 );
+    }
+    
+    void LinuxManager::buildDeviceList()
+    {
+        //watched first, so nodes that appear while scanning are not missed
+        if( !watcher.watch( inputDirectory, "event" ) )
+            std::cerr << "Could not watch " << inputDirectory << " for hot plugging" << std::endl;
+        scanDirectory();
+    }
+    
+    void LinuxManager::scanDirectory()
+    {
+        DIR * dir = opendir( inputDirectory.c_str() );
+        if( !dir ) return;
+        
+        std::vector<std::string> nodes;
+        struct dirent * entry;
+        while( ( entry = readdir( dir ) ) != 0 )
+        {
+            if( strncmp( entry->d_name, "event", 5 ) == 0 )
+                nodes.push_back( entry->d_name );
+        }
+        closedir( dir );
+        
+        std::sort( nodes.begin(), nodes.end(), compareEventNodes );
+        
+        for( std::vector<std::string>::iterator n = nodes.begin(); n != nodes.end(); n++ )
+        {
+            plugNode( inputDirectory + "/" + *n );
+        }
+    }
+    
+    void LinuxManager::plugNode( const std::string & path )
+    {
+        for( tPhysicalDevices::iterator i = mPhysicalDevices.begin(); i != mPhysicalDevices.end(); i++ )
+        {
+            if( static_cast<LinuxDeviceDescriptor*>( *i )->getPath() == path ) return;
+        }
+        
+        LinuxDeviceDescriptor * descriptor = openDevice( path );
+        if( descriptor )
+        {
+            mPhysicalDevices.push_back( descriptor );
+            devicePlugged( descriptor );
+        }
+    }
+    
+    void LinuxManager::unplugNode( const std::string & path )
+    {
+        for( tPhysicalDevices::iterator i = mPhysicalDevices.begin(); i != mPhysicalDevices.end(); i++ )
+        {
+            LinuxDeviceDescriptor * dd = static_cast<LinuxDeviceDescriptor*>( *i );
+            if( dd->getPath() == path )
+            {
+                mPhysicalDevices.erase( i );
+                deviceUnplugged( dd );
+                delete dd;
+                return;
+            }
+        }
+    }
+    
+    void LinuxManager::poll()
+    {
+        //only the nodes that changed, the rest stay bound as they are
+        std::vector<std::string> appeared, removed;
+        if( !watcher.read( appeared, removed ) )
+            scanDirectory();
+        for( std::vector<std::string>::iterator n = removed.begin(); n != removed.end(); n++ )
+        {
+            unplugNode( *n );
+        }
+        for( std::vector<std::string>::iterator n = appeared.begin(); n != appeared.end(); n++ )
+        {
+            plugNode( *n );
+        }
+        
+        for( tPhysicalDevices::iterator i = mPhysicalDevices.begin(); i != mPhysicalDevices.end(); )
+        {
+            LinuxDeviceDescriptor * dd = static_cast<LinuxDeviceDescriptor*>( *i );
+            if( dd->drain() )
+            {
+                i++;
+            }
+            else
+            {
+                deviceUnplugged( dd );
+                delete dd;
+                i = mPhysicalDevices.erase( i );
+            }
+        }
+    }
+    
+    void LinuxManager::cleanup()
+    {
+        for( tPhysicalDevices::iterator i = mPhysicalDevices.begin(); i!=mPhysicalDevices.end(); i++ )
+        {
+            deviceUnplugged( * i );
+            delete *i;
+        }
+        mPhysicalDevices.clear();
+    }
+}
@@ -0,0 +1,143 @@
+/*
+ The MIT License (MIT)
+ 
+ Copyright (c) 2013 Juan Borda
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#pragma once
+#include <vector>
+#include <map>
+#include "HIDCollapse.h"
+#include "DeviceNodeWatcher.h"
+
+namespace HIDCollapse
+{
+    /**
+     * A joystick or gamepad exposed through an evdev node (/dev/input/eventN).
+     * EV_KEY and EV_ABS codes are reported as elements with the HID usages
+     * the kernel's hid-input driver translated them from, so configs written
+     * against OSX usages match the same device here.
+     */
+    class HIDC_EXPORT LinuxDeviceDescriptor: public DeviceDescriptor
+    {
+    public:
+        LinuxDeviceDescriptor( const std::string & name ,
+                              int64_t vendorID, int64_t productID, int64_t versionID ,
+                              int fd , const std::string & path );
+        virtual ~LinuxDeviceDescriptor();
+        virtual bool evaluateElementAndUpdateDescriptor( ElementDescriptor & ed ,
+                                                        int64_t * outVal,
+                                                        int64_t * outMin ,
+                                                        int64_t * outMax );
+        virtual bool evaluateBinding( const ElementBinding & eb , int64_t * outVal );
+        
+        virtual void listElementDescriptors( std::vector<ElementDescriptor> & out );
+        
+        //applies every pending input event without blocking
+        //and reports each change with its kernel timestamp.
+        //returns false once the device is gone
+        bool drain();
+        
+        const std::string & getPath() const;
+        
+        int fd;
+        
+    protected:
+        struct LinuxElement
+        {
+            int type;
+            int code;
+            int64_t min, max;
+            ElementDescriptor descriptor;
+        };
+        
+        typedef std::vector<LinuxElement> tElements;
+        typedef std::map<std::string, LinuxElement*> tStrMap;
+        typedef std::map<int64_t, LinuxElement*> tSeqMap;
+        typedef std::map<tHIDUsage, LinuxElement*> tUsageMap;
+        
+        void enumerateElements();
+        void addElement( int type, int code, int64_t min, int64_t max );
+        //re-reads every value from the kernel. used at open and after dropped events
+        void resync();
+        int64_t currentValue( const LinuxElement & e ) const;
+        
+        //reports e if its value is no longer before
+        void reportIfChanged( LinuxElement * e , int64_t before , uint64_t time );
+        
+        static bool usageForKey( int code , tHIDUsage & out );
+        static bool usageForAbs( int code , tHIDUsage & out );
+        static std::string nameForCode( int type , int code );
+        
+        std::string path;
+        
+        //fixed once enumerated, descriptors point into it
+        tElements elements;
+        tStrMap nameMap;
+        tSeqMap seqMap;
+        tUsageMap usageMap;
+        
+        //latest values indexed by event code
+        std::vector<int32_t> keyValues;
+        std::vector<int32_t> absValues;
+        
+        //elements indexed by event code, null where the device has none
+        std::vector<LinuxElement*> keyElements;
+        std::vector<LinuxElement*> absElements;
+        LinuxElement * hatElement;
+        
+        //event timestamps come from CLOCK_MONOTONIC, otherwise read time is used
+        bool monotonicTimestamps;
+        
+        //the kernel dropped events. the rest of that report is incomplete,
+        //ignored up to and including its SYN_REPORT, then values are re-read
+        bool dropping;
+    };
+    
+    class HIDC_EXPORT LinuxManager: public Manager
+    {
+    public:
+        LinuxManager( const std::string & inputDirectory = "/dev/input" );
+        virtual ~LinuxManager();
+        
+    protected:
+        void cleanup();
+        
+        //plugs and unplugs the nodes that came and went since the last poll,
+        //then drains every device's pending events
+        virtual void poll();
+        
+        //plugs what inputDirectory holds now and watches it for the rest
+        virtual void buildDeviceList();
+        
+        //plugs every node of inputDirectory that has no descriptor yet
+        void scanDirectory();
+        //opens path and plugs it, unless a descriptor has it open already
+        void plugNode( const std::string & path );
+        void unplugNode( const std::string & path );
+        
+        //opens path and returns a descriptor if it is a joystick or gamepad
+        LinuxDeviceDescriptor * openDevice( const std::string & path );
+        
+        std::string inputDirectory;
+        DeviceNodeWatcher watcher;
+    };
+}
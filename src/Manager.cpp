@@ -22,6 +22,8 @@
  THE SOFTWARE.
  */
 
+#include <unistd.h>
+#include <algorithm>
 #include "HIDCollapse.h"
 //#include <boost/log/trivial.hpp>
 #define BOOST_LOG_TRIVIAL(which) std::cout
@@ -29,24 +31,69 @@
 namespace HIDCollapse
 {
     
-    Manager::Manager()
+    Manager::Manager():useConfigCache( false ),
+    mHandlesDirty( false ),
+    mInputThreadStarted( false ),
+    mInputThreadStop( false ),
+    mInputThreadInterval( 0 )
     {
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init( &attr );
+        pthread_mutexattr_settype( &attr, PTHREAD_MUTEX_RECURSIVE );
+        pthread_mutex_init( &mDeviceMutex, &attr );
+        pthread_mutexattr_destroy( &attr );
+        pthread_mutex_init( &mHandleMutex, 0 );
+        publishPlayers();
+    }
+    
+    //held by the game thread for handles and player changes,
+    //and by the input thread only around handing them over
+    class HandleLock
+    {
+    public:
+        HandleLock( pthread_mutex_t & m ):mutex( m ) { pthread_mutex_lock( &mutex ); }
+        ~HandleLock() { pthread_mutex_unlock( &mutex ); }
+    private:
+        HandleLock( const HandleLock & );
+        HandleLock & operator=( const HandleLock & );
+        pthread_mutex_t & mutex;
+    };
+    
+    Manager::DeviceLock::DeviceLock( Manager & m ):manager( m )
+    {
+        pthread_mutex_lock( &manager.mDeviceMutex );
+    }
+    
+    Manager::DeviceLock::~DeviceLock()
+    {
+        pthread_mutex_unlock( &manager.mDeviceMutex );
     }
     
     void Manager::initialize(const std::string & f )
     {
+        DeviceLock lock( *this );
         parseIndexDefinitions( f );
         buildDeviceList();
         buildIndices();
     }
     
+    void Manager::enableConfigCache( const std::string & directory )
+    {
+        useConfigCache = true;
+        configCacheDirectory = directory;
+    }
+    
     Manager::~Manager()
     {
+        stopInputThread();
         clear();
+        pthread_mutex_destroy( &mHandleMutex );
+        pthread_mutex_destroy( &mDeviceMutex );
     }
     
     void Manager::clear()
     {
+        stopInputThread();
         for( tIndices::iterator i = mIndices.begin();
             i!= mIndices.end();
             i++)
@@ -54,15 +101,117 @@ namespace HIDCollapse
             delete * i;
         }
         mIndices.clear();
+        mPlayers.clear();
+        mPlayerRequests.clear();
+        publishPlayers();
+        mDeviceIndices.clear();
+        mReconnections.clear();
+        mLayouts.clear();
+        mStateStore.clear();
+        //pending events point at the indices just deleted
+        mEvents.discard();
+        mMatcher.clear();
         indexDefinitions.clear();
     }
     
+    void Manager::capture()
+    {
+        if( !mInputThreadStarted )
+            update();
+        mStateStore.acquire();
+        mStateStore.updateEdges();
+    }
+    
+    void Manager::poll()
+    {
+    }
+    
+    void Manager::update()
+    {
+        DeviceLock lock( *this );
+        poll();
+        
+        std::vector< std::pair<Index *, int> > requests;
+        {
+            HandleLock handles( mHandleMutex );
+            requests.swap( mPlayerRequests );
+        }
+        for( size_t r = 0; r < requests.size(); r++ )
+            assignPlayer( requests[r].first, requests[r].second );
+        
+        mStateStore.sample();
+        for( tPhysicalDevices::iterator i = mPhysicalDevices.begin(); i != mPhysicalDevices.end(); i++ )
+        {
+            mStateStore.collectChanges( *i, mEvents );
+            (*i)->clearChanges();
+        }
+        
+        {
+            HandleLock handles( mHandleMutex );
+            if( mHandlesDirty )
+                resolveHandles();
+            mStateStore.sampleHandles();
+        }
+        mStateStore.publish();
+    }
+    
+    bool Manager::startInputThread( unsigned intervalMicroseconds )
+    {
+        if( mInputThreadStarted )
+            return true;
+        
+        mInputThreadInterval = intervalMicroseconds;
+        mInputThreadStop.store( false );
+        if( pthread_create( &mInputThread, 0, inputThreadMain, this ) != 0 )
+            return false;
+        mInputThreadStarted = true;
+        return true;
+    }
+    
+    void Manager::stopInputThread()
+    {
+        if( !mInputThreadStarted )
+            return;
+        
+        mInputThreadStop.store( true );
+        pthread_join( mInputThread, 0 );
+        mInputThreadStarted = false;
+    }
+    
+    bool Manager::isInputThreadRunning() const
+    {
+        return mInputThreadStarted;
+    }
+    
+    void * Manager::inputThreadMain( void * manager )
+    {
+        Manager * m = ( Manager * ) manager;
+        while( !m->mInputThreadStop.load() )
+        {
+            m->update();
+            usleep( m->mInputThreadInterval );
+        }
+        return 0;
+    }
+    
+    const StateStore & Manager::getStateStore() const
+    {
+        return mStateStore;
+    }
+    
+    EventQueue & Manager::getEventQueue()
+    {
+        return mEvents;
+    }
+    
     //adds Index definitions to this Manager
     void Manager::parseIndexDefinitions( const std::string & file  )
     {
         try
         {
-            bool res = parse_file(file, indexDefinitions );
+            bool res = useConfigCache ?
+                parse_file_cached( file, indexDefinitions, configCacheDirectory ) :
+                parse_file( file, indexDefinitions );
             if( !res )
             {
                 indexDefinitions.clear();                
@@ -72,31 +221,90 @@ namespace HIDCollapse
         {
              BOOST_LOG_TRIVIAL(error) << "Exception: " << e.what() << std::endl ;
         }
+        
+        for( ast::hidCollapseList::const_iterator d = indexDefinitions.begin(); d != indexDefinitions.end(); d++ )
+        {
+            Index::checkNameHashes( d->entries, d->index );
+        }
+        
+        mMatcher.compile( indexDefinitions );
+    }
+    
+    Index * Manager::findIndexWithPhysicalDevice( const DeviceDescriptor * physicalDevice )
+    {
+        tDeviceIndices::iterator i = mDeviceIndices.find( physicalDevice );
+        if( i != mDeviceIndices.end() ) return i->second;
+        return 0;
     }
     
-    struct makeDescriptor: public boost::static_visitor<DeviceDescriptor>
+    void Manager::bindPhysicalDevice( Index * index , DeviceDescriptor * physicalDevice )
     {
-        DeviceDescriptor operator()(const std::string & key ) const
+        DeviceDescriptor * previous = index->getPhysicalDevice();
+        if( previous )
         {
-            return DeviceDescriptor( key );
+            mDeviceIndices.erase( previous );
         }
-        DeviceDescriptor operator()(const ast::devicePair & key ) const
+        if( physicalDevice )
         {
-            return DeviceDescriptor( key.vendor, key.product );
+            mDeviceIndices[physicalDevice] = index;
         }
-        DeviceDescriptor operator()(const ast::deviceTriplet & key ) const
+        index->setPhysicalDevice( physicalDevice );
+        //any player fallback depends on which indices have a device
+        mHandlesDirty = true;
+        publishPlayers();
+    }
+    
+    Manager::tPlayerSnapshot Manager::loadPlayers() const
+    {
+        return boost::atomic_load( &mPlayerSnapshot );
+    }
+    
+    void Manager::publishPlayers()
+    {
+        boost::shared_ptr<PlayerSnapshot> snapshot( new PlayerSnapshot );
+        snapshot->players = mPlayers;
+        snapshot->anyPlayer = 0;
+        for( tPlayers::iterator p = mPlayers.begin(); p != mPlayers.end(); p++ )
         {
-            return DeviceDescriptor( key.vendor, key.product, key.version );
+            if( p->second->getPhysicalDevice() )
+            {
+                snapshot->anyPlayer = p->second;
+                break;
+            }
         }
-    };
+        
+        snapshot->indices = mIndices;
+        for( tIndices::iterator i = mIndices.begin(); i != mIndices.end(); i++ )
+        {
+            if( DeviceDescriptor * pd = (*i)->getPhysicalDevice() )
+                snapshot->devices.push_back( std::make_pair( *i, DeviceDescriptor( *pd ) ) );
+        }
+        
+        boost::atomic_store( &mPlayerSnapshot, tPlayerSnapshot( snapshot ) );
+    }
     
-    Index * Manager::findIndexWithPhysicalDevice( const DeviceDescriptor * physicalDevice )
+    Index::tLayout Manager::getLayout( const ast::entries & entries , const DeviceDescriptor & physicalDevice ,
+                                      const std::vector<ElementDescriptor> & physicalElements )
     {
-        for( tIndices::iterator ind = mIndices.begin(); ind != mIndices.end(); ind++)
+        Index::tLayout & layout = mLayouts[ std::make_pair( &entries, IndexLayout::modelKey( physicalDevice, physicalElements ) ) ];
+        if( !layout )
         {
-            if( (*ind)->getPhysicalDevice() == physicalDevice ) return *ind;
+            layout = IndexLayout::compile( entries, physicalElements );
         }
-        return 0;
+        return layout;
+    }
+    
+    Index * Manager::createIndex( const ast::hidCollapse & definition , DeviceDescriptor * physicalDevice )
+    {
+        //build an index for this device
+        //element mapping occurrs at an OS-aware level
+        //so let the implementaiton of createIndex and createElements handle that
+        Index * newIndex = new Index( this, definition.entries , definition.index );
+        bindPhysicalDevice( newIndex, physicalDevice );
+        mIndices.push_back( newIndex );
+        
+        putInNextAvailablePlayerSlot( newIndex );
+        return newIndex;
     }
     
     void Manager::buildIndices()
@@ -115,35 +323,18 @@ namespace HIDCollapse
         }
         */
         
-        for( ast::hidCollapseList::iterator d = indexDefinitions.begin();
-            d != indexDefinitions.end() ;
-            d++ )
+        for( tPhysicalDevices::iterator i= mPhysicalDevices.begin() ;
+            i!= mPhysicalDevices.end() ;
+            i++ )
         {
-            //build a comparable device descriptor ot compare with the ones
-            //generated by the operating system specific code
-            DeviceDescriptor declaredDevice = boost::apply_visitor( makeDescriptor() , d->device );
+            DeviceDescriptor * physicalDevice = *i;
             
-            for( tPhysicalDevices::iterator i= mPhysicalDevices.begin() ;
-                i!= mPhysicalDevices.end() ;
-                i++ )
+            if( !findIndexWithPhysicalDevice( physicalDevice ) )
             {
-                DeviceDescriptor * physicalDevice = *i;
-                
-                Index * existing = findIndexWithPhysicalDevice( physicalDevice );
-                
-                if( !existing )
+                const ast::hidCollapse * definition = mMatcher.match( physicalDevice );
+                if( definition )
                 {
-                    if( declaredDevice.fuzzyCompareType( physicalDevice ) > DeviceDescriptor::MATCH_THRESHOLD )
-                    {
-                        //build an index for this device
-                        //element mapping occurrs at an OS-aware level
-                        //so let the implementaiton of createIndex and createElements handle that
-                        Index * newIndex = new Index( this, d->entries , d->index );
-                        newIndex->setPhysicalDevice( physicalDevice );
-                        mIndices.push_back( newIndex );
-                        
-                        putInNextAvailablePlayerSlot(newIndex);
-                    }
+                    createIndex( *definition, physicalDevice );
                 }
             }
         }
@@ -151,54 +342,76 @@ namespace HIDCollapse
     
     void Manager::devicePlugged( DeviceDescriptor * physicalDevice )
     {
-        bool matchedExisting = false;
-        
         Index * existing = findIndexWithPhysicalDevice(physicalDevice);
         if( existing ) return;
         
-        //look for matching deviceless index
-        for( tIndices::iterator i = mIndices.begin(); i != mIndices.end() ; i++ )
+        Index * index = findReconnection( physicalDevice );
+        if( index )
+        {
+            bindPhysicalDevice( index, physicalDevice );
+            index->forgetDevice();
+            
+             BOOST_LOG_TRIVIAL(trace) << "Reconnected physical device (" << physicalDevice->getVendorProductCombo() << ") to Player [" << index->getPlayer() << "] with existing index \"" << index->getName() << "\"" << std::endl;
+        }
+        else
+        {
+            //look for matching index declaration and create an index
+            const ast::hidCollapse * definition = mMatcher.match( physicalDevice );
+            if( definition )
+            {
+                createIndex( *definition, physicalDevice );
+            }
+        }
+    }
+    
+    Index * Manager::findReconnection( const DeviceDescriptor * physicalDevice )
+    {
+        const std::string & identity = physicalDevice->getIdentity();
+        if( !identity.empty() )
+        {
+            tReconnections::iterator r = mReconnections.find( identity );
+            if( r != mReconnections.end() )
+            {
+                Index * index = r->second.front();
+                r->second.pop_front();
+                if( r->second.empty() )
+                    mReconnections.erase( r );
+                return index;
+            }
+        }
+        
+        //the most similar type among the rest
+        Index * best = 0;
+        float bestScore = DeviceDescriptor::MATCH_THRESHOLD;
+        for( tIndices::iterator i = mIndices.begin(); i != mIndices.end(); i++ )
         {
             Index * index = * i;
-            if( !index->getPhysicalDevice() )
+            DeviceDescriptor * dd = index->recallDevice();
+            if( index->getPhysicalDevice() || !dd ) continue;
+            //another unit of the same model, its own device may still come back.
+            //locations don't tell, the same unit may come back in another port
+            if( physicalDevice->hasSerialIdentity() && dd->hasSerialIdentity() ) continue;
+            
+            float score = dd->fuzzyCompareType( physicalDevice );
+            if( score >= bestScore && ( !best || score > bestScore ) )
             {
-                DeviceDescriptor * dd = index->recallDevice();
-                if( dd && dd->fuzzyCompareType( physicalDevice ) )
-                {
-                    index->setPhysicalDevice( physicalDevice );
-                    index->forgetDevice();
-                    matchedExisting = true;
-                    
-                     BOOST_LOG_TRIVIAL(trace) << "Reconnected physical device (" << physicalDevice->getVendorProductCombo() << ") to Player [" << index->getPlayer() << "] with existing index \"" << index->getName() << "\"" << std::endl;
-                }
+                best = index;
+                bestScore = score;
             }
         }
         
-        if( !matchedExisting )
+        if( best && !best->recallDevice()->getIdentity().empty() )
         {
-            //build look for matching index delcaration and create an index
-            for( ast::hidCollapseList::iterator d = indexDefinitions.begin();
-                d != indexDefinitions.end() ;
-                d++ )
+            tReconnections::iterator r = mReconnections.find( best->recallDevice()->getIdentity() );
+            if( r != mReconnections.end() )
             {
-                //build a comparable device descriptor ot compare with the ones
-                //generated by the operating system specific code
-                DeviceDescriptor declaredDevice = boost::apply_visitor( makeDescriptor() , d->device );
-                
-                if( declaredDevice.fuzzyCompareType( physicalDevice ) > DeviceDescriptor::MATCH_THRESHOLD )
-                {
-                    //build an index for this device
-                    //element mapping occurrs at an OS-aware level
-                    //so let the implementaiton of createIndex and createElements handle that
-                    Index * newIndex = new Index( this, d->entries , d->index );
-                    newIndex->setPhysicalDevice( physicalDevice );
-                    mIndices.push_back( newIndex );
-                    
-                    putInNextAvailablePlayerSlot( newIndex );
-                    return;
-                }
+                std::deque<Index *>::iterator q = std::find( r->second.begin(), r->second.end(), best );
+                if( q != r->second.end() ) r->second.erase( q );
+                if( r->second.empty() )
+                    mReconnections.erase( r );
             }
         }
+        return best;
     }
     
     void Manager::putInNextAvailablePlayerSlot(HIDCollapse::Index *newIndex)
@@ -212,6 +425,8 @@ namespace HIDCollapse
             {
                 mPlayers[player]= newIndex;
                 newIndex->player =  player ;
+                mHandlesDirty = true;
+                publishPlayers();
                 done = true;
                  BOOST_LOG_TRIVIAL(trace) << "Player [" << player << "] now accesses device (" << newIndex->getPhysicalDevice()->getVendorProductCombo() << ") with index type \""<< newIndex->getName() << "\""<< std::endl;
             }
@@ -227,24 +442,21 @@ namespace HIDCollapse
             if( physicalDevice == index->getPhysicalDevice() )
             {
                 index->rememberDevice( * physicalDevice );
-                index->setPhysicalDevice( 0 );
+                bindPhysicalDevice( index, 0 );
+                if( !physicalDevice->getIdentity().empty() )
+                    mReconnections[ physicalDevice->getIdentity() ].push_back( index );
             }
         }
     }
     
     Index * Manager::fetchIndex( int player )
     {
-        tPlayers::iterator p = mPlayers.find( player );
-        if( p != mPlayers.end() )
+        tPlayerSnapshot snapshot = loadPlayers();
+        tPlayers::const_iterator p = snapshot->players.find( player );
+        if( p != snapshot->players.end() )
             return p->second;
         else if ( player < 0 ) //fallback
-        {
-            for (tPlayers::iterator p = mPlayers.begin(); p!= mPlayers.end() ; p++ )
-            {
-                if( p->second->getPhysicalDevice() )
-                    return p->second;
-            }
-        }
+            return snapshot->anyPlayer;
         //no indices
         return 0;
     }
@@ -272,7 +484,96 @@ namespace HIDCollapse
         return 0;
     }
     
+    IndexedButton * Manager::findButton( const ElementName & elementIndex , int player )
+    {
+        Index * i = fetchIndex( player );
+        if( i )
+        {
+            return i->getButton( elementIndex );
+        }
+        
+        return 0;
+    }
+    
+    IndexedAxis * Manager::findAxis( const ElementName & elementIndex , int player )
+    {
+        Index * i = fetchIndex( player );
+        if( i )
+        {
+            return i->getAxis( elementIndex );
+        }
+        
+        return 0;
+    }
+    
+    ElementHandle Manager::getButtonHandle( const std::string & elementIndex , int player )
+    {
+        return getHandle( elementIndex, player, false );
+    }
+    
+    ElementHandle Manager::getAxisHandle( const std::string & elementIndex , int player )
+    {
+        return getHandle( elementIndex, player, true );
+    }
+    
+    ElementHandle Manager::getHandle( const std::string & elementIndex , int player , bool axis )
+    {
+        HandleLock handles( mHandleMutex );
+        if( player < 0 ) player = -1;
+        for( size_t i = 0; i < mHandles.size(); i++ )
+        {
+            const HandleBinding & h = mHandles[i];
+            if( h.player == player && h.axis == axis && h.name == elementIndex )
+                return ElementHandle( (uint32_t) i );
+        }
+        
+        HandleBinding h;
+        h.name = elementIndex;
+        h.player = player;
+        h.axis = axis;
+        mHandles.push_back( h );
+        
+        uint32_t id = (uint32_t) mHandles.size() - 1;
+        resolveHandle( id );
+        return ElementHandle( id );
+    }
+    
+    void Manager::resolveHandle( uint32_t id )
+    {
+        const HandleBinding & h = mHandles[id];
+        StateStore::tSlot slot = StateStore::INVALID_SLOT;
+        
+        Index * i = fetchIndex( h.player );
+        IndexedElement * e = 0;
+        if( i )
+            e = h.axis ? (IndexedElement*) i->getAxis( h.name ) : (IndexedElement*) i->getButton( h.name );
+        if( e )
+            slot = h.axis ? e->getSlot() | StateStore::AXIS_SLOT : e->getSlot();
+        
+        mStateStore.bindHandle( id, slot );
+    }
+    
+    void Manager::resolveHandles()
+    {
+        for( uint32_t id = 0; id < mHandles.size(); id++ )
+            resolveHandle( id );
+        mHandlesDirty = false;
+    }
+    
     void Manager::setPlayerIndex( Index * i , int player  )
+    {
+        if( mInputThreadStarted )
+        {
+            HandleLock handles( mHandleMutex );
+            mPlayerRequests.push_back( std::make_pair( i, player ) );
+            return;
+        }
+        
+        DeviceLock lock( *this );
+        assignPlayer( i, player );
+    }
+    
+    void Manager::assignPlayer( Index * i , int player )
     {
         Index * ex  = 0;
         tPlayers::iterator exi = mPlayers.find( player );
@@ -290,13 +591,16 @@ namespace HIDCollapse
             
             mPlayers[ player ] = i ;
             i->player = player;
+            mHandlesDirty = true;
+            publishPlayers();
         }
     }
     
     void Manager::getPlayers( std::vector<int> & out )
     {
+        tPlayerSnapshot snapshot = loadPlayers();
         out.clear();
-        for( tPlayers::iterator i = mPlayers.begin() ; i != mPlayers.end(); i++ )
+        for( tPlayers::const_iterator i = snapshot->players.begin() ; i != snapshot->players.end(); i++ )
         {
             out.push_back( i->first );
         }
@@ -309,27 +613,26 @@ namespace HIDCollapse
     
     void Manager::getIndices( std::vector< const Index *> & out )
     {
-        for( tIndices::iterator i = mIndices.begin() ;i != mIndices.end(); i++ )
-        {
-            out.push_back( * i );
-        }
+        tPlayerSnapshot snapshot = loadPlayers();
+        out.insert( out.end(), snapshot->indices.begin(), snapshot->indices.end() );
     }
     
     void Manager::getIndicesForDevice( const DeviceDescriptor * dd , std::vector<Index *> & out )
     {
-        for( tIndices::iterator i = mIndices.begin() ;i != mIndices.end(); i++ )
+        tPlayerSnapshot snapshot = loadPlayers();
+        for( size_t i = 0; i < snapshot->devices.size(); i++ )
         {
-            Index * ix = *i;
-            if( ix->getPhysicalDevice()->fuzzyCompareType( dd ) > DeviceDescriptor::MATCH_THRESHOLD )
+            if( snapshot->devices[i].second.fuzzyCompareType( dd ) > DeviceDescriptor::MATCH_THRESHOLD )
             {
-                out.push_back( * i );
+                out.push_back( snapshot->devices[i].first );
             }
         }
     }
     
     void Manager::getIndicesWithName( const std::string & s, std::vector<Index *> & out )
     {
-        for( tIndices::iterator i = mIndices.begin() ;i != mIndices.end(); i++ )
+        tPlayerSnapshot snapshot = loadPlayers();
+        for( tIndices::const_iterator i = snapshot->indices.begin() ;i != snapshot->indices.end(); i++ )
         {
             Index * ix = *i;
             if( ix->getName().compare(s) == 0 )
@@ -26,6 +26,11 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <deque>
+#include <pthread.h>
+#include <boost/atomic.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/unordered_map.hpp>
 #include "HIDCollapse.h"
 #include "HIDCollapseParser.h"
 namespace HIDCollapse
@@ -39,15 +44,57 @@ namespace HIDCollapse
         
         void initialize( const std::string & config );
         
-        //perform any necessary polling to devices 
-        virtual void capture()=0;
+        //call before initialize to keep a compiled copy of the config
+        //and skip parsing it while it doesn't change.
+        //the copy goes beside the config unless a directory is given
+        void enableConfigCache( const std::string & directory = "" );
+        
+        //perform any necessary polling to devices and snapshot
+        //every indexed element. indexed elements read from that snapshot
+        //so call this once per frame before querying them.
+        //while the input thread runs this only picks up its latest frame
+        //button edges compare it to the snapshot of the previous call
+        virtual void capture();
+        
+        //moves device polling and sampling to a thread of its own that
+        //publishes a complete frame every intervalMicroseconds.
+        //hot plugging is handled on that thread too.
+        //returns false if the thread could not be started
+        bool startInputThread( unsigned intervalMicroseconds = 1000 );
+        void stopInputThread();
+        bool isInputThreadRunning() const;
+        
+        //keeps the input thread off devices, indices and players while in scope.
+        //the lookups below don't need it, take it to use the physical
+        //device of an Index or anything else they hand out across threads
+        class HIDC_EXPORT DeviceLock
+        {
+        public:
+            DeviceLock( Manager & );
+            ~DeviceLock();
+        private:
+            DeviceLock( const DeviceLock & );
+            DeviceLock & operator=( const DeviceLock & );
+            Manager & manager;
+        };
        
+        //lookups read the players as of the last change the input thread made
+        //and never wait for it to finish polling.
         //convenience methods to grab button from first available Index
         virtual IndexedButton * findButton( const std::string & elementIndex , int player = -1 );
         virtual IndexedAxis * findAxis( const std::string & elementIndex , int player = -1 );
+        IndexedButton * findButton( const ElementName & elementIndex , int player = -1 );
+        IndexedAxis * findAxis( const ElementName & elementIndex , int player = -1 );
+        
+        //resolve a name once and read it every frame through getStateStore().
+        //handles stay valid for the life of the Manager, resolving the same
+        //name and player twice gives the same handle
+        ElementHandle getButtonHandle( const std::string & elementIndex , int player = -1 );
+        ElementHandle getAxisHandle( const std::string & elementIndex , int player = -1 );
         
         //sets the given index to be player.
-        //if an index already holds this slot, they trade places
+        //if an index already holds this slot, they trade places.
+        //while the input thread runs this takes effect on its next frame
         virtual void setPlayerIndex( Index * , int player );
         
         //negative values gives you any player available
@@ -58,10 +105,27 @@ namespace HIDCollapse
         virtual void getIndicesForDevice( const DeviceDescriptor * abstractDevice , std::vector<Index*> & result );
         virtual void getIndicesWithName( const std::string & , std::vector<Index*> & result );
         
+        //state of every indexed element of every player as of the last capture()
+        const StateStore & getStateStore() const;
+        
+        //every change of an indexed element as the device reported it,
+        //including the ones that came and went between two captures.
+        //pop or drain it once per frame, events are dropped while it is full
+        EventQueue & getEventQueue();
+        
     protected:
         
+        friend class Index;
+        
         virtual void parseIndexDefinitions( const std::string & filename );
         
+        //perform any necessary polling to devices,
+        //including noticing plugged and unplugged ones
+        virtual void poll();
+        
+        //poll, sample, collect events and publish one frame. runs on the input thread if any
+        void update();
+        
         //build a list of available hw devices
         //and put them in mPhysicalDevices
         virtual void buildDeviceList()=0;
@@ -78,15 +142,32 @@ namespace HIDCollapse
         //clears everything, including parsed configuration
         virtual void clear();
         
-        //gets player index.
+        //gets player index from the published players.
         //if player < 0 then returns any one index
         virtual Index * fetchIndex( int player );
         virtual void putInNextAvailablePlayerSlot( Index * newIndex );
         
         Index * findIndexWithPhysicalDevice( const DeviceDescriptor * physicalDevice );
         
+        //the deviceless index physicalDevice should go back to, if any:
+        //the one that first lost a device of its identity, else one that
+        //last had a device of its type, as long as the two don't have
+        //different serial numbers. returns 0 to make a new index instead
+        Index * findReconnection( const DeviceDescriptor * physicalDevice );
+        
+        //creates an index for definition, bound to physicalDevice, in the next free player slot
+        Index * createIndex( const ast::hidCollapse & definition , DeviceDescriptor * physicalDevice );
+        //binds physicalDevice ( or none ) to index and keeps the device->index table current
+        void bindPhysicalDevice( Index * index , DeviceDescriptor * physicalDevice );
+        
         //mapping instructions
         ast::hidCollapseList indexDefinitions;
+        
+        bool useConfigCache;
+        std::string configCacheDirectory;
+        
+        //indexDefinitions compiled for matching
+        DeviceMatcher mMatcher;
 
         //physical devices
         typedef 
@@ -97,9 +178,83 @@ namespace HIDCollapse
         typedef std::vector<Index *> tIndices;
         tIndices mIndices;
         
+        //index currently bound to each physical device
+        typedef boost::unordered_map<const DeviceDescriptor *, Index *> tDeviceIndices;
+        tDeviceIndices mDeviceIndices;
+        
+        //deviceless indices by the identity of the device they last had,
+        //oldest first since units that only have a location can share one
+        typedef boost::unordered_map<std::string, std::deque<Index *> > tReconnections;
+        tReconnections mReconnections;
+        
         //virtual devices
         typedef std::map<int , Index* > tPlayers;
         tPlayers mPlayers;
+        
+        //players and indices as lookups see them. rebuilt whole under the
+        //device lock whenever they change and swapped in with one atomic store,
+        //indices are never rebuilt once bound so handing them out is safe
+        struct PlayerSnapshot
+        {
+            tPlayers players;
+            //what a negative player gets, the first one with a device
+            Index * anyPlayer;
+            std::vector<Index *> indices;
+            //indices with a device, and its type
+            std::vector< std::pair<Index *, DeviceDescriptor> > devices;
+        };
+        typedef boost::shared_ptr<const PlayerSnapshot> tPlayerSnapshot;
+        tPlayerSnapshot mPlayerSnapshot;
+        tPlayerSnapshot loadPlayers() const;
+        void publishPlayers();
+        
+        //player changes asked for while the input thread runs, applied by update()
+        std::vector< std::pair<Index *, int> > mPlayerRequests;
+        void assignPlayer( Index * , int player );
+        
+        //element layouts by definition entries and device model key
+        typedef std::map<std::pair<const ast::entries *, std::string>, Index::tLayout> tLayouts;
+        tLayouts mLayouts;
+        Index::tLayout getLayout( const ast::entries & , const DeviceDescriptor & physicalDevice ,
+                                 const std::vector<ElementDescriptor> & physicalElements );
+        
+        //captured element state, slots are handed out by indices
+        StateStore mStateStore;
+        
+        //what each handle was resolved from, by handle id
+        struct HandleBinding
+        {
+            std::string name;
+            int player;
+            bool axis;
+        };
+        std::vector<HandleBinding> mHandles;
+        
+        //players or devices changed since handles were last resolved
+        bool mHandlesDirty;
+        //guards mHandles, the store's handle slots and mPlayerRequests.
+        //never held while devices are polled
+        pthread_mutex_t mHandleMutex;
+        ElementHandle getHandle( const std::string & elementIndex , int player , bool axis );
+        void resolveHandle( uint32_t id );
+        void resolveHandles();
+        
+        //filled by update() from the changes devices report while polled
+        EventQueue mEvents;
+        
+        //recursive, guards everything but the reader sides of mStateStore and mEvents,
+        //the published players and what mHandleMutex guards
+        pthread_mutex_t mDeviceMutex;
+        
+        pthread_t mInputThread;
+        bool mInputThreadStarted;
+        boost::atomic<bool> mInputThreadStop;
+        unsigned mInputThreadInterval;
+        static void * inputThreadMain( void * manager );
+        
+    private:
+        Manager( const Manager & );
+        Manager & operator=( const Manager & );
     };
 }
 
@@ -24,6 +24,8 @@
 
 #include <IOKit/hid/IOHIDLib.h>
 #include <IOKit/hid/IOHIDDevice.h>
+#include <mach/mach_time.h>
+#include <algorithm>
 #include "IOHIDLib_.h"
 
 #include "OSXManager.h"
@@ -31,14 +33,32 @@
 
 namespace HIDCollapse
 {
-
+    //make ascii c++ strings.
+    //this should't be an issue as we should be getting
+    //ascii strings from wherever they come.
+    //the IOHIDDevice_Get* strings are not ours to release, and absent when the device has none
+    static std::string toString( CFStringRef cfstr )
+    {
+        char str[512] = "";
+        if( cfstr )
+            CFStringGetCString( cfstr , str , sizeof( str ), kCFStringEncodingASCII );
+        return str;
+    }
     
     OSXDeviceDescriptor::OSXDeviceDescriptor( const std::string & manuf, const std::string & product ,
                                              int64_t vendorID, int64_t productID, int64_t versionID ,
                                              IOHIDDeviceRef dev ):
     DeviceDescriptor( manuf , product, vendorID, productID, versionID),
-    deviceRef( dev )
+    deviceRef( dev ),
+    queue( 0 )
     {
+        //the location id holds for as long as it stays in the same port
+        char location[32] = "";
+        long locationID = IOHIDDevice_GetLocationID( deviceRef );
+        if( locationID )
+            snprintf( location, sizeof( location ), "%08lx", locationID );
+        setIdentity( toString( IOHIDDevice_GetSerialNumber( deviceRef ) ), location );
+        
         CFDictionaryRef matching = NULL;
         
         elements = IOHIDDeviceCopyMatchingElements(
@@ -49,7 +69,9 @@ namespace HIDCollapse
         if( elements )
         {
             CFIndex size = CFArrayGetCount( elements );
-            ElementDescriptor element;
+            //listed as they are made, so indexing them does not go through CF again
+            elementDescriptors.resize( size );
+            elementsListed = true;
             
             for( CFIndex i = 0; i < size; i++ )
             {
@@ -57,6 +79,7 @@ namespace HIDCollapse
                 IOHIDElementRef ref = (IOHIDElementRef) CFArrayGetValueAtIndex( elements , i );
                 //build fast access maps/multimaps:
                 
+                ElementDescriptor & element = elementDescriptors[i];
                 makeDescriptor( element , ref );
                 if( element.hidUsage.page >= 0 )
                 {
@@ -71,6 +94,49 @@ namespace HIDCollapse
                     seqMap[element.sequential] = ref;
                 }
             }
+            
+            createQueue();
+        }
+    }
+    
+    void OSXDeviceDescriptor::createQueue()
+    {
+        //deep enough for a few frames of every element of a 1 kHz pad
+        IOHIDQueueRef q = IOHIDQueueCreate( kCFAllocatorDefault, deviceRef, 1024, kIOHIDOptionsTypeNone );
+        if( !q ) return;
+        
+        CFIndex size = CFArrayGetCount( elements );
+        for( CFIndex i = 0; i < size; i++ )
+        {
+            IOHIDElementRef ref = (IOHIDElementRef) CFArrayGetValueAtIndex( elements , i );
+            IOHIDElementType type = IOHIDElementGetType( ref );
+            if( type == kIOHIDElementTypeInput_Misc ||
+               type == kIOHIDElementTypeInput_Button ||
+               type == kIOHIDElementTypeInput_Axis )
+            {
+                IOHIDQueueAddElement( q, ref );
+            }
+        }
+        IOHIDQueueStart( q );
+        queue = q;
+    }
+    
+    void OSXDeviceDescriptor::drain()
+    {
+        if( !queue ) return;
+        
+        //value timestamps are mach absolute time like monotonicMicroseconds()
+        static mach_timebase_info_data_t timebase;
+        if( timebase.denom == 0 )
+            mach_timebase_info( &timebase );
+        
+        IOHIDValueRef value;
+        while( ( value = IOHIDQueueCopyNextValueWithTimeout( queue, 0. ) ) )
+        {
+            IOHIDElementRef ref = IOHIDValueGetElement( value );
+            uint64_t time = IOHIDValueGetTimeStamp( value ) * timebase.numer / timebase.denom / 1000;
+            reportChange( ref, IOHIDValueGetIntegerValue( value ), time );
+            CFRelease( value );
         }
     }
     
@@ -101,6 +167,11 @@ namespace HIDCollapse
     
     OSXDeviceDescriptor::~OSXDeviceDescriptor()
     {
+        if( queue )
+        {
+            IOHIDQueueStop( queue );
+            CFRelease( queue );
+        }
         if( elements )
         {
             CFRelease( elements );
@@ -181,25 +252,35 @@ namespace HIDCollapse
             
     }
 
-    void OSXDeviceDescriptor::listElementDescriptors( std::vector<ElementDescriptor> & out )
+    bool OSXDeviceDescriptor::evaluateBinding( const ElementBinding & eb , int64_t * outVal )
     {
-        CFIndex size = CFArrayGetCount( elements );
-        ElementDescriptor element;
-        out.resize(size);
-        for( CFIndex i = 0; i < size; i++ )
+        IOHIDElementRef ref = (IOHIDElementRef) eb.osReference;
+        if( !ref || IOHIDElementGetDevice( ref ) != deviceRef ) return false;
+        
+        if( outVal )
         {
-            IOHIDElementRef ref = (IOHIDElementRef) CFArrayGetValueAtIndex( elements , i );
-            makeDescriptor( out[i] , ref );
+            IOHIDValueRef tIOHIDValueRef;
+            if( kIOReturnSuccess != IOHIDDeviceGetValue( deviceRef , ref , &tIOHIDValueRef ) )
+                return false;
+            *outVal = IOHIDValueGetIntegerValue( tIOHIDValueRef );
         }
+        return true;
+    }
+    
+    void OSXDeviceDescriptor::listElementDescriptors( std::vector<ElementDescriptor> & out )
+    {
+        out = elementDescriptors;
     }
 
     OSXManager::OSXManager()
     {
         osxHidManager = 0;
+        scheduledRunLoop = 0;
         setup();
     }
     OSXManager::~OSXManager()
     {
+        stopInputThread();
         cleanup();
     }
     
@@ -233,6 +314,10 @@ namespace HIDCollapse
             if( matchUsagePages )
                 CFRelease( matchUsagePages );
             
+            //delivered once poll() schedules the manager on its thread
+            IOHIDManagerRegisterDeviceMatchingCallback( osxHidManager, deviceMatched, this );
+            IOHIDManagerRegisterDeviceRemovalCallback( osxHidManager, deviceRemoved, this );
+            
             //open the Manager
             IOReturn res = IOHIDManagerOpen( osxHidManager, kIOHIDOptionsTypeNone );
             
@@ -244,109 +329,135 @@ namespace HIDCollapse
         }
     }
 
-    void OSXManager::rebuildOsxReportedDevicesList()
+    void OSXManager::deviceMatched( void * context , IOReturn result , void * sender , IOHIDDeviceRef dev )
     {
-        //get the devices
-        CFSetRef devCFSetRef = IOHIDManagerCopyDevices( osxHidManager );
-        
-        if ( devCFSetRef )
-        {
-            osxReportedDevices.clear();
-            
-            //put the devices reported by the manager in a convenient vector
-            CFSetApplyFunction( devCFSetRef, CFSetApplierFunctionCopyToSTLVector, ( void * ) ( & osxReportedDevices ) );
-            
-            // and release the set we copied from the IOHID manager
-            CFRelease( devCFSetRef );
-        }
+        ( (OSXManager *) context )->addDevice( dev );
+    }
+    
+    void OSXManager::deviceRemoved( void * context , IOReturn result , void * sender , IOHIDDeviceRef dev )
+    {
+        ( (OSXManager *) context )->removeDevice( dev );
     }
     
-    void OSXManager::rebuildDeviceDescriptors()
+    void OSXManager::addDevice( IOHIDDeviceRef dev )
     {
-        char manufstr[512];
-        char productstr[512];
+        //scheduling the manager reports the devices already there again
+        if( osxDevices.find( dev ) != osxDevices.end() ) return;
         
-        tPhysicalDevices newDevices;
+        long vendorID;
+        long productID;
+        long versionID;
         
-        //make ascii c++ strings.
-        //this should't be an issue as we should be getting
-        //ascii strings from wherever they come
-        CFStringEncoding toEncoding = kCFStringEncodingASCII;
+        //IOHIDDevice_GetVendorIDSource(IOHIDDeviceRef inIOHIDDeviceRef); //finds out if bluetooth or usb
         
-        for( t_reportedDevices::iterator i= osxReportedDevices.begin(); i != osxReportedDevices.end(); i++ )
-        {
-            IOHIDDeviceRef dev = * i;
-            
-            long vendorID;
-            long productID;
-            long versionID;
-            long location;
-            
-            //IOHIDDevice_GetVendorIDSource(IOHIDDeviceRef inIOHIDDeviceRef); //finds out if bluetooth or usb
-            
-            CFStringRef cfmanuf = IOHIDDevice_GetManufacturer( dev );
-            CFStringGetCString( cfmanuf , manufstr, 512, toEncoding );
-            CFRelease( cfmanuf );
-            
-            CFStringRef cfdevstr = IOHIDDevice_GetProduct( dev );
-            CFStringGetCString( cfdevstr , productstr , 512, toEncoding );
-            CFRelease( cfdevstr );
+        std::string manufstr = toString( IOHIDDevice_GetManufacturer( dev ) );
+        std::string productstr = toString( IOHIDDevice_GetProduct( dev ) );
 
-            vendorID = IOHIDDevice_GetVendorID( dev );
-            productID = IOHIDDevice_GetProductID( dev );
-            versionID = IOHIDDevice_GetVersionNumber( dev );
-            location = IOHIDDevice_GetLocationID( dev );
-            
-            OSXDeviceDescriptor * descriptor = new OSXDeviceDescriptor( manufstr , productstr , //implicit std::string conversion
-                                                                       vendorID , productID, versionID ,
-                                                                        dev );
-            newDevices.push_back( descriptor );
-        }
-
-        for( tPhysicalDevices::iterator i = mPhysicalDevices.begin() ;i != mPhysicalDevices.end() ; i++ )
+        vendorID = IOHIDDevice_GetVendorID( dev );
+        productID = IOHIDDevice_GetProductID( dev );
+        versionID = IOHIDDevice_GetVersionNumber( dev );
+        
+        OSXDeviceDescriptor * descriptor = new OSXDeviceDescriptor( manufstr , productstr ,
+                                                                   vendorID , productID, versionID ,
+                                                                   dev );
+        osxDevices[dev] = descriptor;
+        mPhysicalDevices.push_back( descriptor );
+        devicePlugged( descriptor );
+    }
+    
+    void OSXManager::removeDevice( IOHIDDeviceRef dev )
+    {
+        tDeviceRefs::iterator d = osxDevices.find( dev );
+        if( d == osxDevices.end() ) return;
+        
+        OSXDeviceDescriptor * descriptor = d->second;
+        osxDevices.erase( d );
+        mPhysicalDevices.erase( std::find( mPhysicalDevices.begin(), mPhysicalDevices.end(), descriptor ) );
+        deviceUnplugged( descriptor );
+        delete descriptor;
+    }
+    
+    //private run loop mode, running it runs nothing else scheduled on the thread
+    static const CFStringRef HOT_PLUG_MODE = CFSTR( "HIDCollapseHotPlug" );
+    
+    void OSXManager::poll()
+    {
+        if( osxHidManager )
         {
-            deviceUnplugged( *i );
-            delete *i;
+            //callbacks go to whichever thread polls, which changes
+            //when the input thread starts or stops
+            CFRunLoopRef runLoop = CFRunLoopGetCurrent();
+            if( runLoop != scheduledRunLoop )
+            {
+                if( scheduledRunLoop )
+                {
+                    IOHIDManagerUnscheduleFromRunLoop( osxHidManager, scheduledRunLoop, HOT_PLUG_MODE );
+                    CFRelease( scheduledRunLoop );
+                }
+                IOHIDManagerScheduleWithRunLoop( osxHidManager, runLoop, HOT_PLUG_MODE );
+                scheduledRunLoop = (CFRunLoopRef) CFRetain( runLoop );
+            }
+            
+            //only the devices that came or went since the last poll
+            while( CFRunLoopRunInMode( HOT_PLUG_MODE, 0, true ) == kCFRunLoopRunHandledSource );
         }
-        mPhysicalDevices.clear();
-        mPhysicalDevices.assign( newDevices.begin(), newDevices.end() );
         
-        for( tPhysicalDevices::iterator i = mPhysicalDevices.begin() ;i != mPhysicalDevices.end() ; i++ )
+        for( tPhysicalDevices::iterator i = mPhysicalDevices.begin(); i != mPhysicalDevices.end(); i++ )
         {
-            devicePlugged( * i );
-        }        
+            static_cast<OSXDeviceDescriptor*>( *i )->drain();
+        }
     }
     
     void OSXManager::buildDeviceList()
     {
-        rebuildOsxReportedDevicesList();
-        rebuildDeviceDescriptors();
-    }
-    
-    void OSXManager::capture()
-    {
-        //?
+        if( !osxHidManager ) return;
+        
+        //get the devices
+        CFSetRef devCFSetRef = IOHIDManagerCopyDevices( osxHidManager );
+        
+        if ( devCFSetRef )
+        {
+            t_reportedDevices reported;
+            
+            //put the devices reported by the manager in a convenient vector
+            CFSetApplyFunction( devCFSetRef, CFSetApplierFunctionCopyToSTLVector, ( void * ) ( & reported ) );
+            
+            // and release the set we copied from the IOHID manager
+            CFRelease( devCFSetRef );
+            
+            for( t_reportedDevices::iterator i = reported.begin(); i != reported.end(); i++ )
+            {
+                addDevice( *i );
+            }
+        }
     }
-
     
     void OSXManager::cleanup()
     {
-        for( tPhysicalDevices::iterator i = mPhysicalDevices.begin(); i!=mPhysicalDevices.end(); i++ )
+        for( tDeviceRefs::iterator i = osxDevices.begin(); i != osxDevices.end(); i++ )
         {
-            deviceUnplugged( * i );
-            delete *i;
+            deviceUnplugged( i->second );
+            delete i->second;
         }
+        osxDevices.clear();
         mPhysicalDevices.clear();
 
         if( osxHidManager )
         {
+            if( scheduledRunLoop )
+            {
+                IOHIDManagerUnscheduleFromRunLoop( osxHidManager, scheduledRunLoop, HOT_PLUG_MODE );
+            }
             IOHIDManagerClose( osxHidManager , kIOHIDOptionsTypeNone );
             //CFRelease( osxHidManager );
         }
         osxHidManager = 0;
         
-        osxReportedDevices.clear();
-        
+        if( scheduledRunLoop )
+        {
+            CFRelease( scheduledRunLoop );
+        }
+        scheduledRunLoop = 0;
     }
     
     //release the result after you are finished
@@ -25,6 +25,7 @@
 #pragma once
 #include <IOKit/hid/IOHIDManager.h>
 #include <vector>
+#include <map>
 #include "HIDCollapse.h"
 
 namespace HIDCollapse
@@ -53,11 +54,18 @@ namespace HIDCollapse
                                                         int64_t * outVal,
                                                         int64_t * outMin ,
                                                         int64_t * outMax );
+        virtual bool evaluateBinding( const ElementBinding & eb , int64_t * outVal );
 
         virtual void listElementDescriptors( std::vector<ElementDescriptor> & out );
-                
+        
+        //reports every value change queued since the last call
+        void drain();
+        
         IOHIDDeviceRef deviceRef;
         CFArrayRef elements;
+        //input queue of every input element, the descriptor's own
+        //since it lives exactly as long as the device is plugged in
+        IOHIDQueueRef queue;
     protected:
         typedef std::map<std::string,IOHIDElementRef> tStrMap;
         typedef std::map<int64_t, IOHIDElementRef> tSeqMap;
@@ -66,6 +74,8 @@ namespace HIDCollapse
         tSeqMap seqMap;
         tUsageMap usageMap;
         
+        void createQueue();
+        
         
         static void makeDescriptor( ElementDescriptor & ed, IOHIDElementRef );
     };
@@ -79,18 +89,34 @@ namespace HIDCollapse
     protected:
         void setup();
         void cleanup();
-        void rebuildOsxReportedDevicesList();
-        void rebuildDeviceDescriptors();
+        
+        //makes a descriptor for dev and plugs it, unless it has one already
+        void addDevice( IOHIDDeviceRef dev );
+        //unplugs and deletes dev's descriptor, if it has one
+        void removeDevice( IOHIDDeviceRef dev );
+        
+        //runs the hot plug callbacks due, then drains every device's input queue
+        virtual void poll();
         
         IOHIDManagerRef osxHidManager;
         typedef std::vector<IOHIDDeviceRef> t_reportedDevices;
-
-        t_reportedDevices osxReportedDevices;
+        
+        //descriptor made for each device the manager reported
+        typedef std::map<IOHIDDeviceRef, OSXDeviceDescriptor*> tDeviceRefs;
+        tDeviceRefs osxDevices;
+        
+        //retained run loop of the thread that polls, the manager's
+        //matching and removal callbacks are scheduled on it
+        CFRunLoopRef scheduledRunLoop;
                     
+        //adds the devices present now, poll() adds and removes the rest
         virtual void buildDeviceList();
-        virtual void capture();
         
     private:
+        static void deviceMatched( void * context , IOReturn result , void * sender , IOHIDDeviceRef dev );
+        static void deviceRemoved( void * context , IOReturn result , void * sender , IOHIDDeviceRef dev );
+        
+
         //helper functions to setup the system
         static CFMutableArrayRef buildMultiDeviceList( const UInt32 *inUsagePages, const UInt32 *inUsages, int inNumDeviceTypes );
         static CFMutableDictionaryRef setUpMatchingDictionary( UInt32 inUsagePage, UInt32 inUsage );
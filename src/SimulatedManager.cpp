@@ -0,0 +1,314 @@
+/*
+ The MIT License (MIT)
+ 
+ Copyright (c) 2013 Juan Borda
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include <algorithm>
+#include "SimulatedManager.h"
+
+namespace HIDCollapse
+{
+    
+    SimulatedElement::SimulatedElement( int64_t page , int64_t usage , int64_t min , int64_t max ,
+                                       const std::string & name ):
+    page( page ), usage( usage ), min( min ), max( max ), name( name )
+    {
+    }
+    
+    SimulatedDevice::SimulatedDevice( const std::string & manufacturer , const std::string & product ,
+                                     int64_t vendorID , int64_t productID , int64_t versionID ):
+    manufacturer( manufacturer ), product( product ),
+    vendorID( vendorID ), productID( productID ), versionID( versionID )
+    {
+    }
+    
+    SimulatedDevice & SimulatedDevice::button( int64_t usage )
+    {
+        return element( SimulatedElement( 0x09, usage, 0, 1 ) );
+    }
+    
+    SimulatedDevice & SimulatedDevice::axis( int64_t page , int64_t usage , int64_t min , int64_t max )
+    {
+        return element( SimulatedElement( page, usage, min, max ) );
+    }
+    
+    SimulatedDevice & SimulatedDevice::element( const SimulatedElement & e )
+    {
+        elements.push_back( e );
+        return *this;
+    }
+    
+    SimulatedDevice & SimulatedDevice::serial( const std::string & s )
+    {
+        serialNumber = s;
+        return *this;
+    }
+    
+    SimulatedDevice & SimulatedDevice::port( const std::string & s )
+    {
+        location = s;
+        return *this;
+    }
+    
+    SimulatedDeviceDescriptor::SimulatedDeviceDescriptor( const SimulatedDevice & description ):
+    DeviceDescriptor( description.manufacturer, description.product,
+                     description.vendorID, description.productID, description.versionID )
+    {
+        setIdentity( description.serialNumber, description.location );
+        
+        elements.resize( description.elements.size() );
+        for( size_t i = 0; i < elements.size(); i++ )
+        {
+            const SimulatedElement & source = description.elements[i];
+            SimElement & e = elements[i];
+            
+            e.value = source.min;
+            e.min = source.min;
+            e.max = source.max;
+            e.descriptor.hidUsage.page = source.page;
+            e.descriptor.hidUsage.usage = source.usage;
+            e.descriptor.nameKey = source.name;
+            e.descriptor.sequential = i;
+            e.descriptor.osReference = & e;
+            
+            if( source.page >= 0 && usageMap.find( e.descriptor.hidUsage ) == usageMap.end() )
+            {
+                usageMap[e.descriptor.hidUsage] = & e;
+            }
+            if( source.name.size() > 0 )
+            {
+                nameMap[source.name] = & e;
+            }
+            seqMap[i] = & e;
+        }
+    }
+    
+    SimulatedDeviceDescriptor::~SimulatedDeviceDescriptor()
+    {
+    }
+    
+    bool SimulatedDeviceDescriptor::evaluateElementAndUpdateDescriptor( ElementDescriptor & ed ,
+                                                                       int64_t * outVal ,
+                                                                       int64_t * outMin ,
+                                                                       int64_t * outMax )
+    {
+        SimElement * finalElem = 0;
+        
+        //trust the reference only if it is one of ours and still describes the same element
+        if( ed.osReference && !elements.empty() )
+        {
+            SimElement * ref = (SimElement *) ed.osReference;
+            if( ref >= & elements.front() && ref <= & elements.back() &&
+               ref->descriptor.sequential == ed.sequential &&
+               ref->descriptor.hidUsage.page == ed.hidUsage.page &&
+               ref->descriptor.hidUsage.usage == ed.hidUsage.usage )
+            {
+                finalElem = ref;
+            }
+        }
+        
+        if( !finalElem )
+        {
+            tUsageMap::iterator e = usageMap.find( ed.hidUsage );
+            if( e != usageMap.end() )
+            {
+                finalElem = e->second;
+            }
+        }
+        
+        if( !finalElem )
+        {
+            tStrMap::iterator e = nameMap.find( ed.nameKey );
+            if( e != nameMap.end() )
+            {
+                finalElem = e->second;
+            }
+        }
+        
+        if( !finalElem )
+        {
+            tSeqMap::iterator e = seqMap.find( ed.sequential );
+            if( e != seqMap.end() )
+            {
+                finalElem = e->second;
+            }
+        }
+        
+        if( finalElem )
+        {
+            if( outVal ) *outVal = finalElem->value;
+            if( outMin ) *outMin = finalElem->min;
+            if( outMax ) *outMax = finalElem->max;
+            
+            //modify ref
+            ed.osReference = finalElem;
+            return true;
+        }
+        return false;
+    }
+    
+    bool SimulatedDeviceDescriptor::evaluateBinding( const ElementBinding & eb , int64_t * outVal )
+    {
+        if( !eb.osReference || elements.empty() ) return false;
+        SimElement * ref = (SimElement *) eb.osReference;
+        if( ref < & elements.front() || ref > & elements.back() ||
+           (uint32_t) ref->descriptor.sequential != eb.cookie ||
+           (uint16_t) ref->descriptor.hidUsage.page != eb.page ||
+           (uint16_t) ref->descriptor.hidUsage.usage != eb.usage )
+            return false;
+        
+        if( outVal ) *outVal = ref->value;
+        return true;
+    }
+    
+    void SimulatedDeviceDescriptor::listElementDescriptors( std::vector<ElementDescriptor> & out )
+    {
+        out.resize( elements.size() );
+        for( size_t i = 0; i < elements.size(); i++ )
+        {
+            out[i] = elements[i].descriptor;
+        }
+    }
+    
+    size_t SimulatedDeviceDescriptor::getElementCount() const
+    {
+        return elements.size();
+    }
+    
+    void SimulatedDeviceDescriptor::setValue( size_t element , int64_t value )
+    {
+        if( element < elements.size() )
+            setElementValue( elements[element], value );
+    }
+    
+    int64_t SimulatedDeviceDescriptor::getValue( size_t element ) const
+    {
+        if( element < elements.size() )
+            return elements[element].value;
+        return 0;
+    }
+    
+    bool SimulatedDeviceDescriptor::setUsageValue( int64_t page , int64_t usage , int64_t value )
+    {
+        tUsageMap::iterator e = usageMap.find( tHIDUsage( page, usage ) );
+        if( e == usageMap.end() ) return false;
+        setElementValue( *e->second, value );
+        return true;
+    }
+    
+    void SimulatedDeviceDescriptor::setElementValue( SimElement & e , int64_t value )
+    {
+        if( e.value == value ) return;
+        e.value = value;
+        reportChange( &e, value, monotonicMicroseconds() );
+    }
+    
+    SimulatedManager::SimulatedManager():frame( 0 ), listed( false )
+    {
+    }
+    
+    SimulatedManager::~SimulatedManager()
+    {
+        stopInputThread();
+        cleanup();
+    }
+    
+    SimulatedDeviceDescriptor * SimulatedManager::plug( const SimulatedDevice & description )
+    {
+        DeviceLock lock( *this );
+        SimulatedDeviceDescriptor * device = new SimulatedDeviceDescriptor( description );
+        mPhysicalDevices.push_back( device );
+        if( listed )
+        {
+            devicePlugged( device );
+        }
+        return device;
+    }
+    
+    void SimulatedManager::unplug( SimulatedDeviceDescriptor * device )
+    {
+        DeviceLock lock( *this );
+        tPhysicalDevices::iterator i = std::find( mPhysicalDevices.begin(), mPhysicalDevices.end(), device );
+        if( i == mPhysicalDevices.end() ) return;
+        
+        mPhysicalDevices.erase( i );
+        deviceUnplugged( device );
+        
+        //drop whatever was still scheduled for it
+        for( tScript::iterator s = script.begin(); s != script.end(); )
+        {
+            if( s->second.device == device )
+                script.erase( s++ );
+            else
+                s++;
+        }
+        
+        delete device;
+    }
+    
+    void SimulatedManager::schedule( uint64_t at , SimulatedDeviceDescriptor * device , size_t element , int64_t value )
+    {
+        DeviceLock lock( *this );
+        ScheduledValue v;
+        v.device = device;
+        v.element = element;
+        v.value = value;
+        script.insert( std::make_pair( at, v ) );
+    }
+    
+    void SimulatedManager::poll()
+    {
+        tScript::iterator due = script.upper_bound( frame );
+        for( tScript::iterator s = script.begin(); s != due; s++ )
+        {
+            s->second.device->setValue( s->second.element, s->second.value );
+        }
+        script.erase( script.begin(), due );
+        
+        frame++;
+    }
+    
+    uint64_t SimulatedManager::getFrame() const
+    {
+        return frame;
+    }
+    
+    void SimulatedManager::buildDeviceList()
+    {
+        listed = true;
+        for( tPhysicalDevices::iterator i = mPhysicalDevices.begin(); i != mPhysicalDevices.end(); i++ )
+        {
+            devicePlugged( * i );
+        }
+    }
+    
+    void SimulatedManager::cleanup()
+    {
+        for( tPhysicalDevices::iterator i = mPhysicalDevices.begin(); i != mPhysicalDevices.end(); i++ )
+        {
+            deviceUnplugged( * i );
+            delete *i;
+        }
+        mPhysicalDevices.clear();
+        script.clear();
+    }
+}
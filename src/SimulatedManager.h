@@ -0,0 +1,158 @@
+/*
+ The MIT License (MIT)
+ 
+ Copyright (c) 2013 Juan Borda
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#pragma once
+#include <vector>
+#include <map>
+#include "HIDCollapse.h"
+
+namespace HIDCollapse
+{
+    //an element of a simulated device
+    struct HIDC_EXPORT SimulatedElement
+    {
+        SimulatedElement( int64_t page , int64_t usage , int64_t min = 0 , int64_t max = 1 ,
+                         const std::string & name = "" );
+        int64_t page, usage;
+        int64_t min, max;
+        std::string name;
+    };
+    
+    /**
+     * Declarative description of a simulated device:
+     * SimulatedDevice( "Logitech", "Dual Action", 0x46d, 0xc216 )
+     *     .button( 1 ).button( 2 ).axis( 0x1, 0x30, 0, 255 )
+     */
+    struct HIDC_EXPORT SimulatedDevice
+    {
+        SimulatedDevice( const std::string & manufacturer , const std::string & product ,
+                        int64_t vendorID = -1 , int64_t productID = -1 , int64_t versionID = -1 );
+        
+        //adds a button page element
+        SimulatedDevice & button( int64_t usage );
+        SimulatedDevice & axis( int64_t page , int64_t usage , int64_t min , int64_t max );
+        SimulatedDevice & element( const SimulatedElement & );
+        
+        //tells units of the same model apart on reconnection
+        SimulatedDevice & serial( const std::string & );
+        //where it is plugged in, for units without a serial
+        SimulatedDevice & port( const std::string & );
+        
+        std::string manufacturer, product;
+        int64_t vendorID, productID, versionID;
+        std::string serialNumber, location;
+        std::vector<SimulatedElement> elements;
+    };
+    
+    class HIDC_EXPORT SimulatedDeviceDescriptor: public DeviceDescriptor
+    {
+    public:
+        SimulatedDeviceDescriptor( const SimulatedDevice & description );
+        virtual ~SimulatedDeviceDescriptor();
+        virtual bool evaluateElementAndUpdateDescriptor( ElementDescriptor & ed ,
+                                                        int64_t * outVal,
+                                                        int64_t * outMin ,
+                                                        int64_t * outMax );
+        virtual bool evaluateBinding( const ElementBinding & eb , int64_t * outVal );
+        
+        virtual void listElementDescriptors( std::vector<ElementDescriptor> & out );
+        
+        //elements are numbered in description order
+        size_t getElementCount() const;
+        void setValue( size_t element , int64_t value );
+        int64_t getValue( size_t element ) const;
+        
+        //sets the first element with this usage. returns false if there is none
+        bool setUsageValue( int64_t page , int64_t usage , int64_t value );
+        
+    protected:
+        struct SimElement
+        {
+            int64_t value, min, max;
+            ElementDescriptor descriptor;
+        };
+        
+        //sets and reports the change as happening now
+        void setElementValue( SimElement & e , int64_t value );
+        
+        typedef std::vector<SimElement> tElements;
+        typedef std::map<std::string, SimElement*> tStrMap;
+        typedef std::map<int64_t, SimElement*> tSeqMap;
+        typedef std::map<tHIDUsage, SimElement*> tUsageMap;
+        
+        //fixed at construction, descriptors point into it
+        tElements elements;
+        tStrMap nameMap;
+        tSeqMap seqMap;
+        tUsageMap usageMap;
+    };
+    
+    /**
+     * In process backend with no hardware behind it.
+     * Devices can be plugged before initialize() to be present at startup
+     * or at any time after to simulate hot plugging.
+     * Values can be set directly or scheduled for a given frame,
+     * frame n being the n-th poll counting from 0, which is the n-th
+     * call to capture() unless the input thread is running.
+     * With the input thread running, values set directly on a device
+     * must be set while holding a DeviceLock.
+     */
+    class HIDC_EXPORT SimulatedManager: public Manager
+    {
+    public:
+        SimulatedManager();
+        virtual ~SimulatedManager();
+        
+        //the manager owns the returned device until it is unplugged
+        SimulatedDeviceDescriptor * plug( const SimulatedDevice & description );
+        void unplug( SimulatedDeviceDescriptor * device );
+        
+        //applied at the start of that frame's poll, in scheduling order
+        void schedule( uint64_t frame , SimulatedDeviceDescriptor * device , size_t element , int64_t value );
+        
+        //number of polls so far
+        uint64_t getFrame() const;
+        
+    protected:
+        //applies due scheduled values
+        virtual void poll();
+        
+        virtual void buildDeviceList();
+        void cleanup();
+        
+        struct ScheduledValue
+        {
+            SimulatedDeviceDescriptor * device;
+            size_t element;
+            int64_t value;
+        };
+        typedef std::multimap<uint64_t, ScheduledValue> tScript;
+        tScript script;
+        
+        uint64_t frame;
+        
+        //whether buildDeviceList already ran, after that plugging notifies right away
+        bool listed;
+    };
+}
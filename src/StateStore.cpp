@@ -0,0 +1,347 @@
+/*
+ The MIT License (MIT)
+ 
+ Copyright (c) 2013 Juan Borda
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#include "HIDCollapse.h"
+
+namespace HIDCollapse
+{
+    
+    StateStore::StateStore():routesDirty( false ),back( 0 ),front( 1 ),edgeButtonCount( 0 ),latest( 2 ),published( 0 )
+    {
+    }
+    
+    StateStore::~StateStore()
+    {
+    }
+    
+    StateStore::tSlot StateStore::addButton( Index * owner , IndexedElement * element )
+    {
+        tSlot slot = (tSlot) buttonOwners.size();
+        buttonOwners.push_back( owner );
+        buttonElements.push_back( element );
+        buttonBindings.resize( buttonOwners.size() );
+        buttonMin.resize( buttonOwners.size() );
+        buttonReported.resize( buttonOwners.size() );
+        resolveButtonRange( slot );
+        return slot;
+    }
+    
+    StateStore::tSlot StateStore::addAxis( Index * owner , IndexedElement * element )
+    {
+        tSlot slot = (tSlot) axisOwners.size();
+        axisOwners.push_back( owner );
+        axisElements.push_back( element );
+        axisBindings.resize( axisOwners.size() );
+        axisMin.resize( axisOwners.size() );
+        axisMax.resize( axisOwners.size() );
+        axisReported.resize( axisOwners.size() );
+        resolveAxisRange( slot );
+        return slot;
+    }
+    
+    void StateStore::resolveRanges( Index * owner )
+    {
+        for( size_t i = 0; i < buttonOwners.size(); i++ )
+        {
+            if( buttonOwners[i] == owner ) resolveButtonRange( i );
+        }
+        for( size_t i = 0; i < axisOwners.size(); i++ )
+        {
+            if( axisOwners[i] == owner ) resolveAxisRange( i );
+        }
+    }
+    
+    void StateStore::resolveButtonRange( size_t i )
+    {
+        int64_t val = 0, min = 0;
+        DeviceDescriptor * pd = buttonOwners[i]->getPhysicalDevice();
+        if( !pd || !resolve( pd, *buttonElements[i], &val, &min, 0 ) )
+            val = min = 0;
+        buttonBindings[i] = ElementBinding( buttonElements[i]->getPhysicalElement() );
+        buttonMin[i] = (int32_t) min;
+        buttonReported[i] = val > min;
+        routesDirty = true;
+    }
+    
+    void StateStore::resolveAxisRange( size_t i )
+    {
+        int64_t val = 0, min = 0, max = 0;
+        DeviceDescriptor * pd = axisOwners[i]->getPhysicalDevice();
+        if( !pd || !resolve( pd, *axisElements[i], &val, &min, &max ) )
+            val = min = max = 0;
+        axisBindings[i] = ElementBinding( axisElements[i]->getPhysicalElement() );
+        axisMin[i] = (int32_t) min;
+        axisMax[i] = (int32_t) max;
+        axisReported[i] = (int32_t) val;
+        routesDirty = true;
+    }
+    
+    void * StateStore::resolve( DeviceDescriptor * pd , IndexedElement & element ,
+                               int64_t * outVal , int64_t * outMin , int64_t * outMax )
+    {
+        ElementDescriptor physicalElement = element.getPhysicalElement();
+        element.osReference = pd->evaluateElementAndUpdateDescriptor( physicalElement, outVal, outMin, outMax ) ?
+            physicalElement.osReference : 0;
+        return element.osReference;
+    }
+    
+    bool StateStore::evaluate( DeviceDescriptor * pd , ElementBinding & binding , IndexedElement & element , int64_t * outVal )
+    {
+        if( pd->evaluateBinding( binding, outVal ) )
+            return true;
+        if( !binding.osReference )
+            return false;
+        void * osReference = resolve( pd, element, outVal, 0, 0 );
+        if( binding.osReference != osReference )
+        {
+            binding.osReference = osReference;
+            routesDirty = true;
+        }
+        return osReference != 0;
+    }
+    
+    ElementDescriptor StateStore::getButtonElement( tSlot slot ) const
+    {
+        return buttonElements[slot]->getPhysicalElement();
+    }
+    
+    ElementDescriptor StateStore::getAxisElement( tSlot slot ) const
+    {
+        return axisElements[slot]->getPhysicalElement();
+    }
+    
+    void StateStore::buildRoutes()
+    {
+        routes.clear();
+        for( size_t i = 0; i < buttonOwners.size(); i++ )
+        {
+            Route r = { false, (tSlot) i };
+            if( buttonBindings[i].osReference )
+                routes.insert( std::make_pair( buttonBindings[i].osReference, r ) );
+        }
+        for( size_t i = 0; i < axisOwners.size(); i++ )
+        {
+            Route r = { true, (tSlot) i };
+            if( axisBindings[i].osReference )
+                routes.insert( std::make_pair( axisBindings[i].osReference, r ) );
+        }
+        routesDirty = false;
+    }
+    
+    void StateStore::collectChanges( const DeviceDescriptor * device , EventQueue & out )
+    {
+        const DeviceDescriptor::tElementChanges & changes = device->getChanges();
+        if( changes.empty() ) return;
+        if( routesDirty ) buildRoutes();
+        
+        InputEvent e;
+        for( size_t c = 0; c < changes.size(); c++ )
+        {
+            const DeviceDescriptor::ElementChange & change = changes[c];
+            std::pair<tRoutes::const_iterator, tRoutes::const_iterator> r = routes.equal_range( change.osReference );
+            for( tRoutes::const_iterator i = r.first; i != r.second; i++ )
+            {
+                tSlot slot = i->second.slot;
+                int32_t value;
+                int32_t * reported;
+                
+                //osReferences of unplugged devices may be reused by new ones
+                if( !i->second.axis )
+                {
+                    if( buttonOwners[slot]->getPhysicalDevice() != device ) continue;
+                    e.index = buttonOwners[slot];
+                    e.type = IndexedElement::BUTTON;
+                    value = change.value > buttonMin[slot];
+                    reported = & buttonReported[slot];
+                }
+                else
+                {
+                    if( axisOwners[slot]->getPhysicalDevice() != device ) continue;
+                    e.index = axisOwners[slot];
+                    e.type = IndexedElement::ABSOLUTE_AXIS;
+                    value = (int32_t) change.value;
+                    reported = & axisReported[slot];
+                }
+                
+                if( value == *reported ) continue;
+                
+                e.slot = slot;
+                e.oldValue = *reported;
+                e.newValue = value;
+                e.time = change.time;
+                out.push( e );
+                *reported = value;
+            }
+        }
+    }
+    
+    void StateStore::sample()
+    {
+        Frame & f = frames[back];
+        int64_t val;
+        
+        //the back frame was last published two publishes ago
+        //so it may be missing slots bound since
+        f.buttonCount = buttonOwners.size();
+        f.axisCount = axisOwners.size();
+        f.buttonBits.resize( ( f.buttonCount + 63 ) / 64 );
+        f.axisRaw.resize( f.axisCount );
+        f.axisMin.resize( f.axisCount );
+        f.axisMax.resize( f.axisCount );
+        f.axisNormalized.resize( f.axisCount );
+        
+        //unplugged or unreadable elements read as released
+        f.buttonBits.zero();
+        for( size_t i = 0; i < f.buttonCount; i++ )
+        {
+            DeviceDescriptor * pd = buttonOwners[i]->getPhysicalDevice();
+            if( pd && evaluate( pd, buttonBindings[i], *buttonElements[i], &val ) )
+            {
+                if( val > buttonMin[i] )
+                    f.buttonBits[ i >> 6 ] |= ( (uint64_t) 1 ) << ( i & 63 );
+            }
+        }
+        
+        //and as 0
+        if( f.axisCount )
+        {
+            memcpy( f.axisMin.get(), axisMin.get(), f.axisCount * sizeof( int32_t ) );
+            memcpy( f.axisMax.get(), axisMax.get(), f.axisCount * sizeof( int32_t ) );
+        }
+        for( size_t i = 0; i < f.axisCount; i++ )
+        {
+            DeviceDescriptor * pd = axisOwners[i]->getPhysicalDevice();
+            if( pd && evaluate( pd, axisBindings[i], *axisElements[i], &val ) )
+            {
+                //ranges can span all of int32_t, so subtract in 64 bits
+                int64_t max_min = (int64_t) axisMax[i] - axisMin[i];
+                f.axisRaw[i] = (int32_t) val;
+                f.axisNormalized[i] = max_min == 0 ? 0.f : ( (int64_t) f.axisRaw[i] - axisMin[i] ) / (float) max_min;
+            }
+            else
+            {
+                f.axisRaw[i] = 0;
+                f.axisNormalized[i] = 0.f;
+            }
+        }
+    }
+    
+    void StateStore::sampleHandles()
+    {
+        Frame & f = frames[back];
+        f.handleSlots.resize( handleSlots.size() );
+        if( handleSlots.size() )
+            memcpy( f.handleSlots.get(), handleSlots.get(), handleSlots.size() * sizeof( tSlot ) );
+    }
+    
+    void StateStore::publish()
+    {
+        frames[back].sequence = ++published;
+        //release so the reader sees the frame's contents along with its index
+        back = latest.exchange( back | FRESH, boost::memory_order_acq_rel ) & ~FRESH;
+    }
+    
+    bool StateStore::acquire()
+    {
+        if( !( latest.load( boost::memory_order_relaxed ) & FRESH ) )
+            return false;
+        front = latest.exchange( front, boost::memory_order_acq_rel ) & ~FRESH;
+        return true;
+    }
+    
+    void StateStore::bindHandle( uint32_t id , tSlot slot )
+    {
+        //slots added by resize are zero, which is a valid button
+        size_t count = handleSlots.size();
+        if( id >= count )
+        {
+            handleSlots.resize( id + 1 );
+            for( size_t i = count; i < id; i++ ) handleSlots[i] = INVALID_SLOT;
+        }
+        handleSlots[id] = slot;
+    }
+    
+    void StateStore::updateEdges()
+    {
+        const Frame & f = frames[front];
+        size_t words = f.buttonBits.size();
+        
+        //slots new to this frame start released
+        edgeButtonCount = f.buttonCount;
+        previousBits.resize( words );
+        pressedBits.resize( words );
+        releasedBits.resize( words );
+        heldFrames.resize( words * 64 );
+        
+        const uint64_t * current = f.buttonBits.get();
+        for( size_t w = 0; w < words; w++ )
+        {
+            uint64_t changed = current[w] ^ previousBits[w];
+            pressedBits[w] = changed & current[w];
+            releasedBits[w] = changed & previousBits[w];
+            previousBits[w] = current[w];
+            
+            //most words are all up and stay that way
+            uint32_t * held = & heldFrames[ w * 64 ];
+            if( !current[w] && !changed ) continue;
+            for( size_t b = 0; b < 64; b++ )
+            {
+                held[b] = ( current[w] >> b ) & 1 ? held[b] + 1 : 0;
+            }
+        }
+    }
+    
+    void StateStore::clear()
+    {
+        buttonOwners.clear();
+        buttonElements.clear();
+        buttonBindings.clear();
+        axisOwners.clear();
+        axisElements.clear();
+        axisBindings.clear();
+        buttonMin.clear();
+        axisMin.clear();
+        axisMax.clear();
+        buttonReported.clear();
+        axisReported.clear();
+        handleSlots.clear();
+        routes.clear();
+        routesDirty = false;
+        previousBits.clear();
+        pressedBits.clear();
+        releasedBits.clear();
+        heldFrames.clear();
+        edgeButtonCount = 0;
+        for( int i = 0; i < 3; i++ )
+        {
+            frames[i].buttonBits.clear();
+            frames[i].axisRaw.clear();
+            frames[i].axisMin.clear();
+            frames[i].axisMax.clear();
+            frames[i].axisNormalized.clear();
+            frames[i].handleSlots.clear();
+            frames[i].buttonCount = frames[i].axisCount = 0;
+        }
+    }
+}
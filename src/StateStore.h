@@ -0,0 +1,306 @@
+/*
+ The MIT License (MIT)
+ 
+ Copyright (c) 2013 Juan Borda
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE.
+ */
+
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <new>
+#include <boost/atomic.hpp>
+#include <boost/unordered_map.hpp>
+#include "HIDCollapse.h"
+
+namespace HIDCollapse
+{
+    //growable array of plain values whose storage starts on a cache line
+    template< typename T >
+    class AlignedArray
+    {
+    public:
+        static const size_t ALIGNMENT = 64;
+        
+        AlignedArray():data(0),count(0),capacity(0)
+        {
+        }
+        
+        ~AlignedArray()
+        {
+            free( data );
+        }
+        
+        //new values are value-initialized, numbers to 0.
+        //throws std::bad_alloc when out of memory
+        void resize( size_t newCount )
+        {
+            if( newCount > capacity )
+            {
+                size_t newCapacity = capacity ? capacity * 2 : ALIGNMENT / sizeof(T);
+                while( newCapacity < newCount ) newCapacity *= 2;
+                
+                void * newData = 0;
+                if( posix_memalign( &newData, ALIGNMENT, newCapacity * sizeof(T) ) != 0 )
+                    throw std::bad_alloc();
+                if( data )
+                    memcpy( newData, data, count * sizeof(T) );
+                free( data );
+                data = (T*) newData;
+                capacity = newCapacity;
+            }
+            for( size_t i = count; i < newCount; i++ )
+                data[i] = T();
+            count = newCount;
+        }
+        
+        void zero()
+        {
+            if( count ) memset( data, 0, count * sizeof(T) );
+        }
+        
+        void clear()
+        {
+            count = 0;
+        }
+        
+        size_t size() const { return count; }
+        T * get() { return data; }
+        const T * get() const { return data; }
+        T & operator[]( size_t i ) { return data[i]; }
+        const T & operator[]( size_t i ) const { return data[i]; }
+        
+    private:
+        AlignedArray( const AlignedArray & );
+        AlignedArray & operator=( const AlignedArray & );
+        
+        T * data;
+        size_t count;
+        size_t capacity;
+    };
+    
+    /**
+     * A logical element name resolved once through Manager::getButtonHandle
+     * or getAxisHandle. It keeps following whatever element answers to that
+     * name for its player across hot plugging and player changes, and reads
+     * as released or 0 while there is none.
+     */
+    struct HIDC_EXPORT ElementHandle
+    {
+        ElementHandle():id( 0xffffffff ){}
+        explicit ElementHandle( uint32_t id ):id( id ){}
+        uint32_t id;
+    };
+    
+    /**
+     * Structure of arrays holding the captured state of every
+     * indexed element of every Index owned by a Manager.
+     * Buttons and axes get their own dense slots.
+     * Button states are packed 64 per word, axis values
+     * live in parallel cache aligned arrays.
+     *
+     * State is triple buffered so sampling can run on its own thread:
+     * the writer samples into a back frame and publishes it,
+     * the reader acquires the latest published frame and keeps
+     * reading it until the next acquire. Neither side ever waits.
+     * Binding ( add*, resolveRanges, sample, collectChanges, publish, clear )
+     * is the writer's, every accessor below acquire() reads the reader's frame.
+     */
+    class HIDC_EXPORT StateStore
+    {
+    public:
+        typedef uint32_t tSlot;
+        
+        StateStore();
+        ~StateStore();
+        
+        //bind an element of owner's physical device to a new slot
+        //and resolve its range. element is kept by address
+        //and refreshed on rebinding, it must outlive the slot
+        tSlot addButton( Index * owner , IndexedElement * element );
+        tSlot addAxis( Index * owner , IndexedElement * element );
+        
+        //re-reads the ranges of every slot owned by owner.
+        //ranges don't change while a device stays connected
+        //so this is only needed when owner gets a new physical device
+        void resolveRanges( Index * owner );
+        
+        //polls the value of every bound element once into the back frame
+        void sample();
+        
+        //copies the handle slots into the back frame. kept apart from sample()
+        //so whoever binds handles only waits for this copy
+        void sampleHandles();
+        
+        //turns the changes device reported into events for every slot
+        //bound to a changed element of it, oldest first
+        void collectChanges( const DeviceDescriptor * device , EventQueue & out );
+        
+        //makes the back frame the latest one
+        void publish();
+        
+        //makes the latest published frame the one read by the accessors.
+        //returns false if nothing was published since the last call
+        bool acquire();
+        
+        //compares the frame being read with the one read at the previous call,
+        //call once after every acquire() whether it returned true or not
+        void updateEdges();
+        
+        //points handle id at slot, marked with AXIS_SLOT for axes,
+        //or at nothing with INVALID_SLOT. seen from the next sampleHandles() on
+        void bindHandle( uint32_t id , tSlot slot );
+        static const tSlot AXIS_SLOT = 0x80000000;
+        static const tSlot INVALID_SLOT = 0xffffffff;
+        
+        //releases every slot. the writer must not be running
+        void clear();
+        
+        //number of publish() calls that led to the frame being read
+        uint64_t getSequence() const { return frames[front].sequence; }
+        
+        //slots bound after the frame being read was sampled are not in it
+        //and read as released or 0
+        size_t getButtonCount() const { return frames[front].buttonCount; }
+        size_t getAxisCount() const { return frames[front].axisCount; }
+        
+        bool isPressed( tSlot slot ) const
+        {
+            const Frame & f = frames[front];
+            return slot < f.buttonCount && ( ( f.buttonBits[ slot >> 6 ] >> ( slot & 63 ) ) & 1 );
+        }
+        int32_t getAxisRaw( tSlot slot ) const { return slot < frames[front].axisCount ? frames[front].axisRaw[slot] : 0; }
+        int32_t getAxisMin( tSlot slot ) const { return slot < frames[front].axisCount ? frames[front].axisMin[slot] : 0; }
+        int32_t getAxisMax( tSlot slot ) const { return slot < frames[front].axisCount ? frames[front].axisMax[slot] : 0; }
+        float getAxisNormalized( tSlot slot ) const { return slot < frames[front].axisCount ? frames[front].axisNormalized[slot] : 0.f; }
+        
+        //edges as of the last updateEdges()
+        bool wasPressed( tSlot slot ) const
+        {
+            return slot < edgeButtonCount && ( ( pressedBits[ slot >> 6 ] >> ( slot & 63 ) ) & 1 );
+        }
+        bool wasReleased( tSlot slot ) const
+        {
+            return slot < edgeButtonCount && ( ( releasedBits[ slot >> 6 ] >> ( slot & 63 ) ) & 1 );
+        }
+        //consecutive updateEdges() calls the button was down for, 0 when up
+        uint32_t getHeldFrames( tSlot slot ) const { return slot < edgeButtonCount ? heldFrames[slot] : 0; }
+        
+        //the same through handles. one more array access, no lookups
+        tSlot getHandleSlot( ElementHandle h ) const
+        {
+            const Frame & f = frames[front];
+            return h.id < f.handleSlots.size() ? f.handleSlots[h.id] : INVALID_SLOT;
+        }
+        bool isPressed( ElementHandle h ) const { return isPressed( getHandleSlot( h ) ); }
+        bool wasPressed( ElementHandle h ) const { return wasPressed( getHandleSlot( h ) ); }
+        bool wasReleased( ElementHandle h ) const { return wasReleased( getHandleSlot( h ) ); }
+        uint32_t getHeldFrames( ElementHandle h ) const { return getHeldFrames( getHandleSlot( h ) ); }
+        int32_t getAxisRaw( ElementHandle h ) const { return getAxisRaw( getHandleSlot( h ) ^ AXIS_SLOT ); }
+        int32_t getAxisMin( ElementHandle h ) const { return getAxisMin( getHandleSlot( h ) ^ AXIS_SLOT ); }
+        int32_t getAxisMax( ElementHandle h ) const { return getAxisMax( getHandleSlot( h ) ^ AXIS_SLOT ); }
+        float getAxisNormalized( ElementHandle h ) const { return getAxisNormalized( getHandleSlot( h ) ^ AXIS_SLOT ); }
+        
+        //raw arrays for scanning every player at once
+        const uint64_t * getButtonBits() const { return frames[front].buttonBits.get(); }
+        size_t getButtonWords() const { return frames[front].buttonBits.size(); }
+        const uint64_t * getPressedBits() const { return pressedBits.get(); }
+        const uint64_t * getReleasedBits() const { return releasedBits.get(); }
+        const float * getAxesNormalized() const { return frames[front].axisNormalized.get(); }
+        
+        //binding, the writer's. descriptors are only read to find elements
+        //again and for diagnostics, sample() reads the compact bindings
+        ElementDescriptor getButtonElement( tSlot slot ) const;
+        ElementDescriptor getAxisElement( tSlot slot ) const;
+        
+    protected:
+        void resolveButtonRange( size_t i );
+        void resolveAxisRange( size_t i );
+        
+        //finds element on pd again from its descriptor and rebinds it,
+        //0 when pd doesn't have it
+        void * resolve( DeviceDescriptor * pd , IndexedElement & element ,
+                       int64_t * outVal , int64_t * outMin , int64_t * outMax );
+        
+        //reads element through binding, falling back to finding it
+        //through its descriptor and rebinding when that fails. elements
+        //pd didn't have aren't looked for again until the next resolve
+        bool evaluate( DeviceDescriptor * pd , ElementBinding & binding , IndexedElement & element , int64_t * outVal );
+        
+        //binding, only walked by sample()
+        std::vector<Index*> buttonOwners, axisOwners;
+        AlignedArray<ElementBinding> buttonBindings, axisBindings;
+        AlignedArray<int32_t> buttonMin, axisMin, axisMax;
+        
+        //what the bindings were made from, cold. owned by the indexed elements
+        std::vector<IndexedElement *> buttonElements, axisElements;
+        
+        //slots by the osReference their element resolved to,
+        //rebuilt by collectChanges() after binding changed
+        struct Route
+        {
+            bool axis;
+            tSlot slot;
+        };
+        typedef boost::unordered_multimap<const void *, Route> tRoutes;
+        tRoutes routes;
+        bool routesDirty;
+        void buildRoutes();
+        
+        //value of each slot as of its last event
+        AlignedArray<int32_t> buttonReported, axisReported;
+        
+        //slot of each handle, copied into every frame
+        AlignedArray<tSlot> handleSlots;
+        
+        //state
+        struct Frame
+        {
+            Frame():sequence(0),buttonCount(0),axisCount(0){}
+            
+            AlignedArray<uint64_t> buttonBits;
+            AlignedArray<int32_t> axisRaw, axisMin, axisMax;
+            AlignedArray<float> axisNormalized;
+            AlignedArray<tSlot> handleSlots;
+            uint64_t sequence;
+            size_t buttonCount, axisCount;
+        };
+        
+        //the latest published frame's index, flagged FRESH until acquired
+        static const uint32_t FRESH = 4;
+        
+        Frame frames[3];
+        uint32_t back;      //writer's
+        uint32_t front;     //reader's
+        
+        //edges, the reader's
+        AlignedArray<uint64_t> previousBits, pressedBits, releasedBits;
+        AlignedArray<uint32_t> heldFrames;
+        size_t edgeButtonCount;
+        boost::atomic<uint32_t> latest;
+        uint64_t published;
+        
+    private:
+        StateStore( const StateStore & );
+        StateStore & operator=( const StateStore & );
+    };
+}